@@ -0,0 +1,353 @@
+#include "first.h"
+
+#include "aio_prefetch.h"
+
+#include <sys/types.h>
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "fdevent.h"
+#include "log.h"
+#include "status_counter.h"
+
+#if defined(HAVE_PTHREAD_H) && defined(RWF_NOWAIT)
+#define AIO_PREFETCH_USE_THREADS
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#ifdef AIO_PREFETCH_USE_THREADS
+
+/* Files not (fully) in page cache block the event loop in sendfile(),
+ * read() or on mmap page faults.  Before writing a FILE_CHUNK, probe
+ * whether the next window of the file is resident with preadv2(RWF_NOWAIT).
+ * If not, hand a pread() of the window to a helper thread and defer writing
+ * to the connection until the helper thread reports completion; the
+ * connection is then rescheduled via the joblist and finds the data in the
+ * page cache.  Data read by helper threads is discarded; only the side
+ * effect of populating the page cache is desired. */
+
+#define AIO_PREFETCH_WINDOW (512*1024)
+#define AIO_PREFETCH_BUFSZ  (64*1024)
+
+typedef struct aio_job {
+    struct aio_job *next;    /* job queue or done list (aio.mutex) */
+    struct aio_job *onext;   /* outstanding jobs (event loop only) */
+    struct aio_job *oprev;
+    void (*cb)(void *);      /* NULL if cancelled */
+    void *ctx;
+    int fd;                  /* dup() of FILE_CHUNK fd; -1 after pread() */
+    off_t offset;
+    off_t len;
+    uint64_t ts;             /* time submitted (usec) */
+} aio_job;
+
+static struct aio_prefetch_st {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    aio_job *queue;
+    aio_job *queue_last;
+    aio_job *done;
+    int stop;
+
+    /* (event loop only) */
+    aio_job *outstanding;
+    pthread_t *threads;
+    unsigned int nthreads;
+    int fds[2];              /* pipe for notification of completed jobs */
+    fdnode *fdn;
+    fdevents *ev;
+    server *srv;
+} aio;
+
+
+static void * aio_prefetch_worker (void *arg) {
+    char * const buf = malloc(AIO_PREFETCH_BUFSZ);
+    UNUSED(arg);
+
+    pthread_mutex_lock(&aio.mutex);
+    for (;;) {
+        aio_job *job;
+        while (NULL == (job = aio.queue) && !aio.stop)
+            pthread_cond_wait(&aio.cond, &aio.mutex);
+        if (aio.stop) break;
+        if (NULL == (aio.queue = job->next)) aio.queue_last = NULL;
+        pthread_mutex_unlock(&aio.mutex);
+
+        for (off_t off = job->offset, end = off + job->len; off < end && buf;) {
+            const size_t sz = end - off > AIO_PREFETCH_BUFSZ
+              ? AIO_PREFETCH_BUFSZ
+              : (size_t)(end - off);
+            const ssize_t rd = pread(job->fd, buf, sz, off);
+            if (rd > 0)
+                off += rd;
+            else if (rd < 0 && errno == EINTR)
+                continue;
+            else
+                break;
+        }
+        close(job->fd);
+        job->fd = -1;
+
+        pthread_mutex_lock(&aio.mutex);
+        job->next = aio.done;
+        aio.done = job;
+        if (NULL == job->next) {
+            /* wake event loop (pipe is drained before done list is taken) */
+            ssize_t wr = write(aio.fds[1], "", 1);
+            UNUSED(wr);
+        }
+    }
+    pthread_mutex_unlock(&aio.mutex);
+
+    free(buf);
+    return NULL;
+}
+
+
+static void aio_prefetch_job_unlink (aio_job * const job) {
+    if (job->oprev)
+        job->oprev->onext = job->onext;
+    else
+        aio.outstanding = job->onext;
+    if (job->onext)
+        job->onext->oprev = job->oprev;
+}
+
+
+static handler_t aio_prefetch_handle_fdevent (void *ctx, int revents) {
+    char buf[64];
+    UNUSED(ctx);
+    UNUSED(revents);
+
+    while (read(aio.fds[0], buf, sizeof(buf)) > 0) ;
+
+    pthread_mutex_lock(&aio.mutex);
+    aio_job *job = aio.done;
+    aio.done = NULL;
+    pthread_mutex_unlock(&aio.mutex);
+    if (NULL == job) return HANDLER_GO_ON;
+
+    const uint64_t ts = fdevent_clock_usec();
+    int * const stall_ms =
+      status_counter_get_counter(CONST_STR_LEN("aio.prefetch.stall-ms"));
+    int * const stall_max_ms =
+      status_counter_get_counter(CONST_STR_LEN("aio.prefetch.stall-max-ms"));
+    do {
+        aio_job * const next = job->next;
+        const int ms = (int)((ts - job->ts) / 1000);
+        *stall_ms += ms;
+        if (*stall_max_ms < ms) *stall_max_ms = ms;
+        aio_prefetch_job_unlink(job);
+        if (job->cb) job->cb(job->ctx);
+        free(job);
+        job = next;
+    } while (job);
+
+    return HANDLER_GO_ON;
+}
+
+
+static int aio_prefetch_resident (const int fd, const off_t off) {
+    /* (returns 1 if resident or if unknown, e.g. RWF_NOWAIT not supported
+     *  on filesystem, so that caller does not attempt read ahead) */
+    char c;
+    struct iovec iov = { &c, 1 };
+    return (preadv2(fd, &iov, 1, off, RWF_NOWAIT) >= 0 || errno != EAGAIN);
+}
+
+
+void * aio_prefetch_chunk (chunk * const c, off_t len, void(*cb)(void *), void *ctx) {
+    if (0 == aio.nthreads || c->file.fd < 0) return NULL;
+
+    off_t off = c->offset;
+    off_t end = off + len;
+    if (end <= c->file.ra_end) return NULL;
+    if (off < c->file.ra_end) off = c->file.ra_end;
+    if (end < off + AIO_PREFETCH_WINDOW) end = off + AIO_PREFETCH_WINDOW;
+    if (end > c->file.length) end = c->file.length;
+    if (off >= end) return NULL;
+    c->file.ra_end = end;
+
+    if (aio_prefetch_resident(c->file.fd, off)
+        && aio_prefetch_resident(c->file.fd, end-1)) {
+        status_counter_inc(CONST_STR_LEN("aio.prefetch.hits"));
+        return NULL;
+    }
+
+    aio_job * const job = malloc(sizeof(aio_job));
+    if (NULL == job) return NULL;
+    job->fd = fdevent_dup_cloexec(c->file.fd);
+    if (job->fd < 0) {
+        free(job);
+        return NULL;
+    }
+    job->next = NULL;
+    job->cb = cb;
+    job->ctx = ctx;
+    job->offset = off;
+    job->len = end - off;
+    job->ts = fdevent_clock_usec();
+
+    job->oprev = NULL;
+    job->onext = aio.outstanding;
+    if (job->onext) job->onext->oprev = job;
+    aio.outstanding = job;
+
+    pthread_mutex_lock(&aio.mutex);
+    if (aio.queue_last)
+        aio.queue_last->next = job;
+    else
+        aio.queue = job;
+    aio.queue_last = job;
+    pthread_cond_signal(&aio.cond);
+    pthread_mutex_unlock(&aio.mutex);
+
+    status_counter_inc(CONST_STR_LEN("aio.prefetch.misses"));
+    return job;
+}
+
+
+void aio_prefetch_cancel (void * const job) {
+    /* (job is freed when helper thread completes read ahead) */
+    ((aio_job *)job)->cb = NULL;
+}
+
+
+static void aio_prefetch_pipe_close (void) {
+    fdevent_fdnode_event_del(aio.ev, aio.fdn);
+    fdevent_unregister(aio.ev, aio.fds[0]);
+    close(aio.fds[0]);
+    close(aio.fds[1]);
+    aio.srv->cur_fds -= 2;
+}
+
+
+int aio_prefetch_init (server * const srv) {
+    const unsigned int nthreads = srv->srvconf.aio_threads;
+    if (0 == nthreads) return 0;
+
+  #ifdef HAVE_PIPE2
+    if (0 != pipe2(aio.fds, O_NONBLOCK | O_CLOEXEC)) {
+  #else
+    if (0 != pipe(aio.fds)
+        || 0 != fdevent_fcntl_set_nb_cloexec(aio.fds[0])
+        || 0 != fdevent_fcntl_set_nb_cloexec(aio.fds[1])) {
+  #endif
+        log_perror(srv->errh, __FILE__, __LINE__, "pipe()");
+        return -1;
+    }
+    srv->cur_fds += 2;
+    aio.srv = srv;
+    aio.ev = srv->ev;
+    aio.fdn = fdevent_register(aio.ev, aio.fds[0],
+                               aio_prefetch_handle_fdevent, NULL);
+    fdevent_fdnode_event_set(aio.ev, aio.fdn, FDEVENT_IN);
+
+    pthread_mutex_init(&aio.mutex, NULL);
+    pthread_cond_init(&aio.cond, NULL);
+    aio.threads = malloc(nthreads * sizeof(pthread_t));
+    force_assert(aio.threads);
+
+    /* signals are handled by the main thread */
+    sigset_t mask, omask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, &omask);
+    for (aio.nthreads = 0; aio.nthreads < nthreads; ++aio.nthreads) {
+        int rc = pthread_create(aio.threads+aio.nthreads, NULL,
+                                aio_prefetch_worker, NULL);
+        if (0 != rc) {
+            errno = rc;
+            log_perror(srv->errh, __FILE__, __LINE__, "pthread_create()");
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &omask, NULL);
+
+    if (aio.nthreads != nthreads) {
+        aio_prefetch_free();
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void aio_prefetch_free (void) {
+    if (NULL == aio.threads) return;
+
+    pthread_mutex_lock(&aio.mutex);
+    aio.stop = 1;
+    pthread_cond_broadcast(&aio.cond);
+    pthread_mutex_unlock(&aio.mutex);
+    for (unsigned int i = 0; i < aio.nthreads; ++i)
+        pthread_join(aio.threads[i], NULL);
+    free(aio.threads);
+    aio.threads = NULL;
+    aio.nthreads = 0;
+
+    for (aio_job *job = aio.outstanding, *next; job; job = next) {
+        next = job->onext;
+        if (job->fd >= 0) close(job->fd);
+        free(job);
+    }
+    aio.outstanding = NULL;
+    aio.queue = aio.queue_last = aio.done = NULL;
+    aio.stop = 0;
+
+    pthread_cond_destroy(&aio.cond);
+    pthread_mutex_destroy(&aio.mutex);
+    aio_prefetch_pipe_close();
+}
+
+
+void aio_prefetch_fork_child (void) {
+    /* helper threads do not exist in child process after fork();
+     * resume connections waiting on read ahead and disable read ahead.
+     * (mutex state is unknown; job memory and fds are abandoned) */
+    if (NULL == aio.threads) return;
+    free(aio.threads);
+    aio.threads = NULL;
+    aio.nthreads = 0;
+    for (aio_job *job = aio.outstanding; job; job = job->onext) {
+        if (job->cb) job->cb(job->ctx);
+    }
+    aio.outstanding = NULL;
+    aio_prefetch_pipe_close();
+}
+
+#else /* !AIO_PREFETCH_USE_THREADS */
+
+int aio_prefetch_init (server * const srv) {
+    if (0 == srv->srvconf.aio_threads) return 0;
+    log_error(srv->errh, __FILE__, __LINE__,
+      "server.aio-threads not supported on this platform; ignoring");
+    srv->srvconf.aio_threads = 0;
+    return 0;
+}
+
+void aio_prefetch_free (void) {
+}
+
+void aio_prefetch_fork_child (void) {
+}
+
+void * aio_prefetch_chunk (chunk * const c, off_t len, void(*cb)(void *), void *ctx) {
+    UNUSED(c);
+    UNUSED(len);
+    UNUSED(cb);
+    UNUSED(ctx);
+    return NULL;
+}
+
+void aio_prefetch_cancel (void * const job) {
+    UNUSED(job);
+}
+
+#endif /* !AIO_PREFETCH_USE_THREADS */
@@ -0,0 +1,27 @@
+#ifndef INCLUDED_AIO_PREFETCH_H
+#define INCLUDED_AIO_PREFETCH_H
+#include "first.h"
+#include "base_decls.h"
+#include "chunk.h"
+
+/* read ahead file data not resident in page cache using a small pool of
+ * helper threads, so that sendfile()/read() from the event loop does not
+ * block on disk I/O (server.aio-threads) */
+
+__attribute_cold__
+int aio_prefetch_init(server *srv);
+
+__attribute_cold__
+void aio_prefetch_free(void);
+
+__attribute_cold__
+void aio_prefetch_fork_child(void);
+
+/* returns NULL if next len bytes of FILE_CHUNK c are in page cache (or if
+ * unknown), else handle of read ahead submitted to helper threads; cb(ctx)
+ * is called from the event loop when the read ahead completes */
+void * aio_prefetch_chunk(chunk *c, off_t len, void(*cb)(void *), void *ctx);
+
+void aio_prefetch_cancel(void *job);
+
+#endif
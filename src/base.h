@@ -36,6 +36,8 @@ struct connection {
 	signed char is_writable;
 	char is_ssl_sock;
 	char traffic_limit_reached;
+	char idle_released;          /* request memory released in keep-alive */
+	void *aio_job;               /* pending aio_prefetch read ahead */
 	uint16_t revents_err;
 	uint16_t proto_default_port;
 
@@ -67,6 +69,12 @@ struct connection {
 	time_t connection_start;
 	uint32_t request_count;      /* number of requests handled in this connection */
 	int keep_alive_idle;         /* remember max_keep_alive_idle from config */
+
+	/* timer wheel (next timeout check) */
+	time_t tw_ts;                /* 0 if not scheduled */
+	struct connection *tw_next;
+	struct connection *tw_prev;
+	int tw_lvl;
 };
 
 typedef struct {
@@ -93,6 +101,9 @@ typedef struct {
 	unsigned char http_method_get_body;
 	unsigned char high_precision_timestamps;
 	unsigned char h2proto;
+	unsigned char reuseport_bpf;
+	unsigned char edge_triggered;
+	unsigned char loop_stats;
 	unsigned short http_url_normalize;
 	unsigned char absolute_dir_redirect;
 
@@ -100,6 +111,15 @@ typedef struct {
 	unsigned short max_fds;
 	unsigned short max_conns;
 	unsigned short port;
+	unsigned short accept_batch;
+	unsigned int busy_poll;      /* usec */
+	unsigned int zerocopy_threshold; /* bytes */
+	unsigned short upgrade_warmup; /* sec */
+	unsigned short aio_threads;
+	unsigned int tcp_notsent_lowat; /* bytes */
+	unsigned int max_request_mem;    /* bytes; 0 for builtin default */
+	unsigned int max_connection_mem; /* bytes; 0 for unlimited */
+	off_t max_mem;                   /* bytes; 0 for unlimited */
 
 	unsigned int upload_temp_file_size;
 	array *upload_tempdirs;
@@ -118,7 +138,9 @@ typedef struct {
 	const buffer *username;
 	const buffer *groupname;
 	const buffer *network_backend;
+	const buffer *upgrade_socket;
 	const array *feature_flags;
+	const array *cpu_affinity;
 	const char *event_handler;
 	buffer *pid_file;
 	buffer *modules_dir;
@@ -152,6 +174,9 @@ struct server {
 
 	struct fdevents *ev;
 	int (* network_backend_write)(int fd, chunkqueue *cq, off_t max_bytes, log_error_st *errh);
+	int network_backend_more; /* MSG_MORE coalesces MEM_CHUNK w/ FILE_CHUNK */
+	uint32_t loop_iter;       /* event loop iterations (write scheduling) */
+	off_t bytes_per_second_cnt[5]; /* server.global-kbytes-per-second */
 	handler_t (* request_env)(request_st *r);
 
 	/* buffers */
@@ -173,6 +198,7 @@ struct server {
 	int max_fds_hiwat;/* high watermark */
 	int cur_fds;    /* currently used fds */
 	int sockets_disabled;
+	int sockets_events;
 
 	uint32_t max_conns;
 
@@ -5,6 +5,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>       /* strftime() */
+#if defined(HAVE_MALLOC_TRIM) || defined(HAVE_MALLINFO2)
+#include <malloc.h>
+#endif
 
 static const char hex_chars_lc[] = "0123456789abcdef";
 static const char hex_chars_uc[] = "0123456789ABCDEF";
@@ -39,15 +42,157 @@ buffer *buffer_init_string(const char *str) {
 	return b;
 }
 
+
+#define BUFFER_PIECE_SIZE 64uL  /*(must be power-of-2)*/
+
+/* size-class pool of buffer memory
+ *
+ * Allocations in (BUFFER_POOL_MIN, BUFFER_POOL_MAX] are rounded up to one of
+ * four size classes per power of 2 (at most 25% larger than requested).
+ * Released memory of a class size is kept on a per-class free list (up to
+ * BUFFER_POOL_LIMIT bytes total) and reused by the next allocation in that
+ * class, instead of churning malloc()/realloc() with chunk buffers and with
+ * request/response buffers of similar sizes.  buffer_pool_trim() is called
+ * periodically and frees blocks which stayed on a free list for the whole
+ * period (the per-class low-water mark).
+ */
+
+#define BUFFER_POOL_MIN_SHIFT 10
+#define BUFFER_POOL_MAX_SHIFT 20
+#define BUFFER_POOL_MIN (1uL << BUFFER_POOL_MIN_SHIFT)
+#define BUFFER_POOL_MAX (1uL << BUFFER_POOL_MAX_SHIFT)
+#define BUFFER_POOL_NCLASSES ((BUFFER_POOL_MAX_SHIFT-BUFFER_POOL_MIN_SHIFT)*4)
+#define BUFFER_POOL_LIMIT (16uL * 1024 * 1024)
+
+typedef struct buffer_pool_block {
+    struct buffer_pool_block *next;
+} buffer_pool_block;
+
+static struct buffer_pool_class {
+    buffer_pool_block *free;
+    uint32_t nfree;
+    uint32_t lwm;   /* low-water mark of nfree since buffer_pool_trim() */
+    uint32_t hwm;   /* high-water mark of nfree since buffer_pool_trim() */
+} buffer_pool[BUFFER_POOL_NCLASSES];
+static size_t buffer_pool_bytes;
+static uint64_t buffer_pool_hits;
+static uint64_t buffer_pool_misses;
+
+__attribute_pure__
+static uint32_t buffer_pool_class (const size_t sz) {
+    /*(BUFFER_POOL_MIN < sz <= BUFFER_POOL_MAX)*/
+    const unsigned long n = (unsigned long)(sz - 1);
+  #if defined(__GNUC__) || defined(__clang__)
+    const uint32_t s = (uint32_t)(sizeof(n)*8 - 1 - __builtin_clzl(n));
+  #else
+    uint32_t s = BUFFER_POOL_MIN_SHIFT;
+    while (n >> (s+1)) ++s;
+  #endif
+    return ((s - BUFFER_POOL_MIN_SHIFT) << 2) + (uint32_t)(n >> (s-2)) - 4;
+}
+
+__attribute_pure__
+static size_t buffer_pool_class_size (const uint32_t i) {
+    return (size_t)(5 + (i & 3)) << (BUFFER_POOL_MIN_SHIFT - 2 + (i >> 2));
+}
+
+size_t buffer_pool_size (size_t sz) {
+    sz = (sz + BUFFER_PIECE_SIZE-1) & ~(BUFFER_PIECE_SIZE-1);
+    return (sz > BUFFER_POOL_MIN && sz <= BUFFER_POOL_MAX)
+      ? buffer_pool_class_size(buffer_pool_class(sz))
+      : sz;
+}
+
+static char * buffer_pool_get (const uint32_t i) {
+    struct buffer_pool_class * const pc = buffer_pool+i;
+    buffer_pool_block * const blk = pc->free;
+    if (NULL == blk) {
+        ++buffer_pool_misses;
+        return NULL;
+    }
+    ++buffer_pool_hits;
+    pc->free = blk->next;
+    if (pc->lwm > --pc->nfree) pc->lwm = pc->nfree;
+    buffer_pool_bytes -= buffer_pool_class_size(i);
+    return (char *)blk;
+}
+
+static void buffer_pool_put (char * const ptr, const size_t sz) {
+    if (NULL != ptr && sz > BUFFER_POOL_MIN && sz <= BUFFER_POOL_MAX
+        && buffer_pool_bytes + sz <= BUFFER_POOL_LIMIT) {
+        const uint32_t i = buffer_pool_class(sz);
+        if (buffer_pool_class_size(i) == sz) {
+            struct buffer_pool_class * const pc = buffer_pool+i;
+            buffer_pool_block * const blk = (buffer_pool_block *)(void *)ptr;
+            blk->next = pc->free;
+            pc->free = blk;
+            if (pc->hwm < ++pc->nfree) pc->hwm = pc->nfree;
+            buffer_pool_bytes += sz;
+            return;
+        }
+    }
+    free(ptr);
+}
+
+void buffer_pool_stats (buffer_pool_stats_t * const st) {
+    memset(st, 0, sizeof(*st));
+    for (uint32_t i = 0; i < BUFFER_POOL_NCLASSES; ++i) {
+        const struct buffer_pool_class * const pc = buffer_pool+i;
+        st->pooled_blocks += pc->nfree;
+        st->hwm_bytes += pc->hwm * buffer_pool_class_size(i);
+        if (pc->nfree) ++st->classes;
+    }
+    st->pooled_bytes = buffer_pool_bytes;
+    st->hits = buffer_pool_hits;
+    st->misses = buffer_pool_misses;
+  #ifdef HAVE_MALLINFO2
+    const struct mallinfo2 mi = mallinfo2();
+    st->heap_bytes = mi.arena + mi.hblkhd;
+    st->heap_free = mi.fordblks;
+  #endif
+}
+
+static void buffer_pool_class_release (struct buffer_pool_class * const pc, uint32_t n) {
+    pc->nfree -= n;
+    while (n--) {
+        buffer_pool_block * const blk = pc->free;
+        pc->free = blk->next;
+        free(blk);
+    }
+}
+
+void buffer_pool_trim (void) {
+    for (uint32_t i = 0; i < BUFFER_POOL_NCLASSES; ++i) {
+        struct buffer_pool_class * const pc = buffer_pool+i;
+        /* release blocks not taken from free list since previous trim */
+        buffer_pool_bytes -= pc->lwm * buffer_pool_class_size(i);
+        buffer_pool_class_release(pc, pc->lwm);
+        pc->lwm = pc->hwm = pc->nfree;
+    }
+  #ifdef HAVE_MALLOC_TRIM
+    malloc_trim(0);
+  #endif
+}
+
+void buffer_pool_free (void) {
+    for (uint32_t i = 0; i < BUFFER_POOL_NCLASSES; ++i) {
+        struct buffer_pool_class * const pc = buffer_pool+i;
+        buffer_pool_class_release(pc, pc->nfree);
+        pc->lwm = pc->hwm = 0;
+    }
+    buffer_pool_bytes = 0;
+}
+
+
 void buffer_free(buffer *b) {
 	if (NULL == b) return;
 
-	free(b->ptr);
+	buffer_pool_put(b->ptr, b->size);
 	free(b);
 }
 
 void buffer_free_ptr(buffer *b) {
-	free(b->ptr);
+	buffer_pool_put(b->ptr, b->size);
 	b->ptr = NULL;
 	b->used = 0;
 	b->size = 0;
@@ -65,10 +210,24 @@ void buffer_move(buffer * restrict b, buffer * restrict src) {
 /* make sure buffer is at least "size" big + 1 for '\0'. keep old data */
 __attribute_cold__
 static void buffer_realloc(buffer * const b, const size_t len) {
-    #define BUFFER_PIECE_SIZE 64uL  /*(must be power-of-2)*/
-    const size_t sz = (len + 1 + BUFFER_PIECE_SIZE-1) & ~(BUFFER_PIECE_SIZE-1);
+    size_t sz = (len + 1 + BUFFER_PIECE_SIZE-1) & ~(BUFFER_PIECE_SIZE-1);
     force_assert(sz > len);
 
+    if (sz > BUFFER_POOL_MIN && sz <= BUFFER_POOL_MAX) {
+        const uint32_t i = buffer_pool_class(sz);
+        char * const ptr = buffer_pool_get(i);
+        sz = buffer_pool_class_size(i);
+        if (NULL != ptr) {
+            if (NULL != b->ptr) {
+                memcpy(ptr, b->ptr, b->size);
+                buffer_pool_put(b->ptr, b->size);
+            }
+            b->ptr = ptr;
+            b->size = sz;
+            return;
+        }
+    }
+
     b->size = sz;
     b->ptr = realloc(b->ptr, sz);
 
@@ -81,7 +240,7 @@ static void buffer_alloc_replace(buffer * const b, const size_t size) {
     force_assert(NULL != b);
     /*(discard old data so realloc() does not copy)*/
     if (NULL != b->ptr) {
-        free(b->ptr);
+        buffer_pool_put(b->ptr, b->size);
         b->ptr = NULL;
     }
     buffer_realloc(b, size);
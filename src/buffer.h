@@ -98,6 +98,32 @@ static inline void buffer_reset(buffer *b);
 __attribute_cold__
 void buffer_free_ptr(buffer *b);
 
+/* size-class pool of buffer memory
+ * - allocations larger than 1k (up to 1M) are rounded up to one of four size
+ *   classes per power of 2 and are kept on per-class free lists when released
+ * - buffer_pool_size() returns allocation size used for a request of sz bytes
+ * - buffer_pool_trim() releases memory which sat unused in the pool since the
+ *   previous call, and returns (trims) free heap memory to the OS
+ */
+typedef struct {
+	size_t pooled_bytes; /* bytes on per-class free lists */
+	size_t hwm_bytes;    /* sum of per-class high-water marks since trim */
+	uint32_t pooled_blocks;
+	uint32_t classes;    /* size classes with blocks on free list */
+	uint64_t hits;       /* allocations served from free lists */
+	uint64_t misses;     /* allocations from malloc() */
+	size_t heap_bytes;   /* (if available) heap size from mallinfo2() */
+	size_t heap_free;    /* (if available) free heap bytes from mallinfo2() */
+} buffer_pool_stats_t;
+
+__attribute_pure__
+size_t buffer_pool_size(size_t sz);
+void buffer_pool_stats(buffer_pool_stats_t *st);
+__attribute_cold__
+void buffer_pool_trim(void);
+__attribute_cold__
+void buffer_pool_free(void);
+
 void buffer_copy_string(buffer * restrict b, const char * restrict s);
 void buffer_copy_string_len(buffer * restrict b, const char * restrict s, size_t s_len);
 static inline void buffer_copy_buffer(buffer * restrict b, const buffer * restrict src);
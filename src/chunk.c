@@ -26,14 +26,16 @@
 #define MAX_TEMPFILE_SIZE (128 * 1024 * 1024)
 
 static size_t chunk_buf_sz = 8192;
-static chunk *chunks, *chunks_oversized;
+static chunk *chunks;
 static chunk *chunk_buffers;
+static uint32_t chunks_nfree;
+static off_t chunk_mem_bytes; /*(sum of c->mem_acct of chunks in use)*/
 static const array *chunkqueue_default_tempdirs = NULL;
 static off_t chunkqueue_default_tempfile_size = DEFAULT_TEMPFILE_SIZE;
 
 void chunkqueue_set_chunk_size (size_t sz)
 {
-    chunk_buf_sz = sz > 0 ? ((sz + 1023) & ~1023uL) : 8192;
+    chunk_buf_sz = sz > 0 ? buffer_pool_size((sz + 1023) & ~1023uL) : 8192;
 }
 
 void chunkqueue_set_tempdirs_default_reset (void)
@@ -115,6 +117,7 @@ static void chunk_reset_file_chunk(chunk *c) {
 		c->file.mmap.length = c->file.mmap.offset = 0;
 	}
 	c->file.length = 0;
+	c->file.ra_end = 0;
 	c->type = MEM_CHUNK;
 }
 
@@ -125,6 +128,33 @@ static void chunk_reset(chunk *c) {
 	c->offset = 0;
 }
 
+/* account for memory held by chunks in use; c->mem->size might change
+ * while chunk is in a chunkqueue (e.g. buffer_move() or buffer growth),
+ * so re-sample where chunk contents are committed to the chunkqueue */
+static inline void chunk_mem_acct(chunk * const c) {
+    const uint32_t sz = c->ring ? c->ring : c->mem->size;
+    chunk_mem_bytes += (off_t)sz - (off_t)c->mem_acct;
+    c->mem_acct = sz;
+}
+
+static inline void chunk_mem_unacct(chunk * const c) {
+    chunk_mem_bytes -= (off_t)c->mem_acct;
+    c->mem_acct = 0;
+}
+
+off_t chunkqueue_mem_total(void) {
+    return chunk_mem_bytes;
+}
+
+off_t chunkqueue_length_mem(const chunkqueue * const cq) {
+    off_t len = 0;
+    for (const chunk *c = cq->first; c; c = c->next) {
+        if (c->type == MEM_CHUNK)
+            len += (off_t)chunk_buffer_string_length(c->mem) - c->offset;
+    }
+    return len;
+}
+
 static void chunk_free(chunk *c) {
 	if (c->type == FILE_CHUNK) chunk_reset_file_chunk(c);
 	buffer_free(c->mem);
@@ -137,6 +167,7 @@ buffer * chunk_buffer_acquire(void) {
     if (chunks) {
         c = chunks;
         chunks = c->next;
+        --chunks_nfree;
     }
     else {
         c = chunk_init(chunk_buf_sz);
@@ -150,12 +181,13 @@ buffer * chunk_buffer_acquire(void) {
 
 void chunk_buffer_release(buffer *b) {
     if (NULL == b) return;
-    if (b->size >= chunk_buf_sz && chunk_buffers) {
+    if (b->size == chunk_buf_sz && chunk_buffers) {
         chunk *c = chunk_buffers;
         chunk_buffers = c->next;
         c->mem = b;
         c->next = chunks;
         chunks = c;
+        ++chunks_nfree;
         buffer_clear(b);
     }
     else {
@@ -165,40 +197,166 @@ void chunk_buffer_release(buffer *b) {
 
 __attribute_returns_nonnull__
 static chunk * chunk_acquire(size_t sz) {
-    if (sz <= chunk_buf_sz) {
-        if (chunks) {
-            chunk *c = chunks;
-            chunks = c->next;
-            return c;
-        }
-        sz = chunk_buf_sz;
+    chunk *c;
+    if (sz <= chunk_buf_sz && chunks) {
+        c = chunks;
+        chunks = c->next;
+        --chunks_nfree;
     }
     else {
-        sz = (sz + 8191) & ~8191uL;
-        /* future: might have buckets of certain sizes, up to socket buf sizes*/
-        if (chunks_oversized && chunks_oversized->mem->size >= sz) {
-            chunk *c = chunks_oversized;
-            chunks_oversized = c->next;
-            return c;
-        }
+        /*(larger buffers are reused from size classes in buffer_pool)*/
+        c = chunk_init(sz <= chunk_buf_sz ? chunk_buf_sz : sz);
     }
+    chunk_mem_acct(c);
+    return c;
+}
 
-    return chunk_init(sz);
+static void chunk_unpin(chunk *c) {
+    /* pass pinned buffer to holder of pin; chunk gets empty buffer */
+    c->pin.release(c->pin.ref, c->mem);
+    c->pin.release = 0; /* NULL fn ptr */
+    c->pin.ref = NULL;
+    c->mem = buffer_init();
+}
+
+/* ring buffers for reading from clients
+ *
+ * A ring is CHUNK_RING_SZ of memory mapped twice at adjacent addresses, so
+ * that data which wraps around the end of the ring is contiguous in memory.
+ * A ring chunk is an otherwise ordinary MEM_CHUNK; its unconsumed data
+ * [c->mem->ptr + c->offset, c->mem->ptr + used-1) is at most CHUNK_RING_SZ-1
+ * bytes and appears again CHUNK_RING_SZ lower once c->offset has passed the
+ * end of the first mapping.  chunk_ring_rebase() moves c->offset and used
+ * down to that copy (no data is moved) and sets c->mem->size so that space
+ * beyond used ends where data would be overwritten.  Request headers and
+ * HTTP/2 frames which straddle reads then remain contiguous in the ring and
+ * need not be compacted into a new buffer.
+ *
+ * Rings are used only while a chunkqueue flagged with chunkqueue_set_ring()
+ * holds unconsumed data, and are kept in a small pool between uses. */
+
+#if defined(MREMAP_FIXED) && defined(MREMAP_MAYMOVE) && defined(MAP_ANONYMOUS)
+#define CHUNK_RING_SZ (64*1024)
+#define CHUNK_RING_POOL_MAX 32
+static chunk *chunk_rings;
+static uint32_t chunk_rings_nfree;
+static int chunk_rings_disabled;
+
+__attribute_cold__
+__attribute_noinline__
+static chunk * chunk_ring_init(void) {
+    char * const ptr = mmap(NULL, CHUNK_RING_SZ*2, PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == ptr) return NULL;
+    /*(MAP_SHARED, so that mremap() with old_size 0 maps same pages again)*/
+    if (MAP_FAILED == mmap(ptr, CHUNK_RING_SZ, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED, -1, 0)
+        || MAP_FAILED == mremap(ptr, 0, CHUNK_RING_SZ,
+                                MREMAP_MAYMOVE | MREMAP_FIXED,
+                                ptr + CHUNK_RING_SZ)) {
+        munmap(ptr, CHUNK_RING_SZ*2);
+        return NULL;
+    }
+
+    chunk * const c = calloc(1, sizeof(*c));
+    force_assert(NULL != c);
+    c->file.fd = -1;
+    c->file.mmap.start = MAP_FAILED;
+    c->mem = calloc(1, sizeof(buffer));
+    force_assert(NULL != c->mem);
+    c->mem->ptr = ptr;
+    c->ring = CHUNK_RING_SZ;
+    return c;
+}
+
+static void chunk_ring_free(chunk * const c) {
+    munmap(c->mem->ptr, CHUNK_RING_SZ*2);
+    free(c->mem);
+    free(c);
+}
+
+static chunk * chunk_ring_acquire(void) {
+    chunk *c = chunk_rings;
+    if (NULL != c) {
+        chunk_rings = c->next;
+        --chunk_rings_nfree;
+    }
+    else if (chunk_rings_disabled || NULL == (c = chunk_ring_init())) {
+        /* e.g. vm.max_map_count reached; use regular chunks */
+        chunk_rings_disabled = 1;
+        return NULL;
+    }
+    c->next = NULL;
+    c->offset = 0;
+    c->mem->used = 1;
+    c->mem->size = CHUNK_RING_SZ;
+    c->mem->ptr[0] = '\0';
+    chunk_mem_acct(c);
+    return c;
+}
+
+static void chunk_ring_release(chunk * const c) {
+    chunk_mem_unacct(c);
+    if (chunk_rings_nfree < CHUNK_RING_POOL_MAX) {
+        c->next = chunk_rings;
+        chunk_rings = c;
+        ++chunk_rings_nfree;
+    }
+    else
+        chunk_ring_free(c);
+}
+
+static void chunk_ring_pool_clear(void) {
+    for (chunk *next, *c = chunk_rings; c; c = next) {
+        next = c->next;
+        chunk_ring_free(c);
+    }
+    chunk_rings = NULL;
+    chunk_rings_nfree = 0;
+    chunk_rings_disabled = 0; /*(retry, e.g. if limit was reached)*/
+}
+
+static void chunk_ring_rebase(chunk * const c) {
+    buffer * const b = c->mem;
+    if ((uint32_t)c->offset == b->used - 1) { /*(empty)*/
+        c->offset = 0;
+        b->used = 1;
+        b->ptr[0] = '\0';
+    }
+    else if (c->offset >= CHUNK_RING_SZ) {
+        c->offset -= CHUNK_RING_SZ;
+        b->used -= CHUNK_RING_SZ;
+    }
+    b->size = (uint32_t)c->offset + CHUNK_RING_SZ;
+}
+
+#else
+
+#define CHUNK_RING_SZ 0
+#define chunk_ring_acquire()   NULL
+#define chunk_ring_release(c)  do { } while (0)
+#define chunk_ring_pool_clear() do { } while (0)
+#define chunk_ring_rebase(c)   do { } while (0)
+
+#endif
+
+void chunkqueue_set_ring (chunkqueue * const cq) {
+    cq->use_ring = 1;
 }
 
 static void chunk_release(chunk *c) {
+    if (c->ring) {
+        chunk_ring_release(c);
+        return;
+    }
+    chunk_mem_unacct(c);
+    if (c->pin.release) chunk_unpin(c);
     const size_t sz = c->mem->size;
     if (sz == chunk_buf_sz) {
         chunk_reset(c);
         c->next = chunks;
         chunks = c;
-    }
-    else if (sz > chunk_buf_sz) {
-        chunk_reset(c);
-        chunk **co = &chunks_oversized;
-        while (*co && sz < (*co)->mem->size) co = &(*co)->next;
-        c->next = *co;
-        *co = c;
+        ++chunks_nfree;
     }
     else {
         chunk_free(c);
@@ -212,11 +370,13 @@ void chunkqueue_chunk_pool_clear(void)
         chunk_free(c);
     }
     chunks = NULL;
-    for (chunk *next, *c = chunks_oversized; c; c = next) {
-        next = c->next;
-        chunk_free(c);
-    }
-    chunks_oversized = NULL;
+    chunks_nfree = 0;
+    chunk_ring_pool_clear();
+}
+
+uint32_t chunkqueue_chunk_pool_count(void)
+{
+    return chunks_nfree;
 }
 
 void chunkqueue_chunk_pool_free(void)
@@ -334,6 +494,7 @@ void chunkqueue_append_buffer(chunkqueue * const restrict cq, buffer * const res
 	c = chunkqueue_append_mem_chunk(cq, chunk_buf_sz);
 	cq->bytes_in += len;
 	buffer_move(c->mem, mem);
+	chunk_mem_acct(c);
 }
 
 
@@ -354,6 +515,7 @@ void chunkqueue_append_mem_min(chunkqueue * const restrict cq, const char * cons
 		return;
 
 	c = chunk_init(len+1);
+	chunk_mem_acct(c);
 	chunkqueue_append_chunk(cq, c);
 	cq->bytes_in += len;
 	buffer_copy_string_len(c->mem, mem, len);
@@ -390,6 +552,7 @@ buffer * chunkqueue_prepend_buffer_open(chunkqueue *cq) {
 
 void chunkqueue_prepend_buffer_commit(chunkqueue *cq) {
 	cq->bytes_in += chunk_buffer_string_length(cq->first->mem);
+	chunk_mem_acct(cq->first);
 }
 
 
@@ -406,6 +569,7 @@ buffer * chunkqueue_append_buffer_open(chunkqueue *cq) {
 
 void chunkqueue_append_buffer_commit(chunkqueue *cq) {
 	cq->bytes_in += chunk_buffer_string_length(cq->last->mem);
+	chunk_mem_acct(cq->last);
 }
 
 
@@ -417,14 +581,21 @@ char * chunkqueue_get_memory(chunkqueue * const restrict cq, size_t * const rest
 	buffer *b;
 	chunk *c = cq->last;
 	if (NULL != c && MEM_CHUNK == c->type) {
-		/* return pointer into existing buffer if large enough */
+		/* return pointer into existing buffer if large enough
+		 * (or any space in ring, which is reclaimed as data is consumed) */
+		if (c->ring) chunk_ring_rebase(c);
 		size_t avail = chunk_buffer_string_space(c->mem);
-		if (avail >= sz) {
+		if (avail >= sz || (c->ring && avail)) {
 			*len = avail;
 			b = c->mem;
 			return b->ptr + chunk_buffer_string_length(b);
 		}
 	}
+	else if (NULL == c && cq->use_ring && NULL != (c = chunk_ring_acquire())) {
+		chunkqueue_append_chunk(cq, c);
+		*len = chunk_buffer_string_space(c->mem);
+		return c->mem->ptr;
+	}
 
 	/* allocate new chunk */
 	b = chunkqueue_append_buffer_open_sz(cq, sz);
@@ -438,6 +609,7 @@ void chunkqueue_use_memory(chunkqueue * const restrict cq, chunk *ckpt, size_t l
     if (len > 0) {
         buffer_commit(b, len);
         cq->bytes_in += len;
+        chunk_mem_acct(cq->last);
         if (cq->last == ckpt || NULL == ckpt || MEM_CHUNK != ckpt->type
             || len > chunk_buffer_string_space(ckpt->mem)) return;
 
@@ -539,6 +711,29 @@ void chunkqueue_steal(chunkqueue * const restrict dest, chunkqueue * const restr
 	}
 }
 
+static int chunkqueue_mkstemp_append(buffer * const restrict template) {
+  #if defined(__linux__) && defined(O_TMPFILE)
+	/* create unnamed temp file in tempdir, if supported by filesystem;
+	 * avoids directory updates to create and unlink() named temp file.
+	 * template is cleared to mark the temp file as unnamed: it is not
+	 * unlink()ed and fd must not be closed until chunk is released, since
+	 * file can not be reopened (see chunk_reset_file_chunk()) */
+	char * const slash = strrchr(template->ptr, '/');
+	if (NULL != slash && slash != template->ptr) {
+		*slash = '\0';
+		const int fd = fdevent_open_cloexec(template->ptr, 1,
+		                                    O_RDWR | O_TMPFILE | O_APPEND,
+		                                    0600);
+		*slash = '/';
+		if (fd >= 0) {
+			buffer_clear(template);
+			return fd;
+		}
+	}
+  #endif
+	return fdevent_mkstemp_append(template->ptr);
+}
+
 static chunk *chunkqueue_get_append_tempfile(chunkqueue * const restrict cq, log_error_st * const restrict errh) {
 	chunk *c;
 	buffer *template = buffer_init_string("/var/tmp/lighttpd-upload-XXXXXX");
@@ -552,10 +747,10 @@ static chunk *chunkqueue_get_append_tempfile(chunkqueue * const restrict cq, log
 
 			buffer_copy_buffer(template, &ds->value);
 			buffer_append_path_len(template, CONST_STR_LEN("lighttpd-upload-XXXXXX"));
-			if (-1 != (fd = fdevent_mkstemp_append(template->ptr))) break;
+			if (-1 != (fd = chunkqueue_mkstemp_append(template))) break;
 		}
 	} else {
-		fd = fdevent_mkstemp_append(template->ptr);
+		fd = chunkqueue_mkstemp_append(template);
 	}
 
 	if (fd < 0) {
@@ -599,8 +794,10 @@ int chunkqueue_append_mem_to_tempfile(chunkqueue * const restrict dest, const ch
 			&& 0 == dst_c->offset) {
 			/* ok, take the last chunk for our job */
 
-			if (dst_c->file.length >= (off_t)dest->upload_temp_file_size) {
-				/* the chunk is too large now, close it */
+			if (dst_c->file.length >= (off_t)dest->upload_temp_file_size
+			    && !chunk_buffer_string_is_empty(dst_c->mem)) {
+				/* the chunk is too large now, close it
+				 * (unnamed temp file can not be reopened; keep appending) */
 				force_assert(0 == dst_c->file.refchg); /*(else should not happen)*/
 				int rc = close(dst_c->file.fd);
 				dst_c->file.fd = -1;
@@ -651,6 +848,11 @@ int chunkqueue_append_mem_to_tempfile(chunkqueue * const restrict dest, const ch
 			if (0 == chunk_remaining_length(dst_c)) {
 				/*(remove empty chunk and unlink tempfile)*/
 				chunkqueue_remove_empty_chunks(dest);
+			} else if (chunk_buffer_string_is_empty(dst_c->mem)) {
+				/*(unnamed tempfile can not be reopened, so leave it open;
+				 * append new tempfile to avoid later attempts to append)*/
+				if (retry && NULL == chunkqueue_get_append_tempfile(dest, errh))
+					return -1;
 			} else {/*(close tempfile; avoid later attempts to append)*/
 				force_assert(0 == dst_c->file.refchg); /*(else should not happen)*/
 				int rc = close(dst_c->file.fd);
@@ -780,6 +982,11 @@ void chunkqueue_compact_mem_offset(chunkqueue * const cq) {
     chunk * const restrict c = cq->first;
     if (0 == c->offset) return;
     if (c->type != MEM_CHUNK) return; /*(should not happen)*/
+    if (c->ring) {
+        /*(do not memmove() within ring; data overlaps via mirror mapping)*/
+        chunk_ring_rebase(c);
+        return;
+    }
 
     buffer * const restrict b = c->mem;
     size_t len = chunk_buffer_string_length(b) - c->offset;
@@ -795,7 +1002,7 @@ void chunkqueue_compact_mem(chunkqueue *cq, size_t clen) {
     buffer *b = c->mem;
     size_t len = chunk_buffer_string_length(b) - c->offset;
     if (len >= clen) return;
-    if (b->size > clen) {
+    if ((c->ring ? c->ring : b->size) > clen) {
         if (chunk_buffer_string_space(b) < clen - len)
             chunkqueue_compact_mem_offset(cq);
     }
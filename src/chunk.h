@@ -40,7 +40,18 @@ typedef struct chunk {
 		} mmap;
 		void *ref;
 		void(*refchg)(void *, int);
+		off_t  ra_end; /* end of range read ahead (aio_prefetch) */
 	} file;
+
+	struct {
+		/* mem-chunk: buffer pinned (e.g. in use by kernel for MSG_ZEROCOPY)
+		 * upon chunk release, buffer ownership is passed to release() */
+		void *ref;
+		void(*release)(void *, buffer *);
+	} pin;
+
+	uint32_t mem_acct; /* c->mem->size included in chunkqueue_mem_total() */
+	uint32_t ring;     /* MEM_CHUNK c->mem is mirrored ring buffer */
 } chunk;
 
 typedef struct chunkqueue {
@@ -52,6 +63,7 @@ typedef struct chunkqueue {
 	const array *tempdirs;
 	off_t upload_temp_file_size;
 	unsigned int tempdir_idx;
+	unsigned int use_ring; /* read into ring buffer (chunkqueue_get_memory())*/
 } chunkqueue;
 
 __attribute_returns_nonnull__
@@ -60,12 +72,18 @@ buffer * chunk_buffer_acquire(void);
 void chunk_buffer_release(buffer *b);
 
 void chunkqueue_chunk_pool_clear(void);
+uint32_t chunkqueue_chunk_pool_count(void);
+
+/* (approximate) memory in buffers of chunks in use by chunkqueues */
+__attribute_pure__
+off_t chunkqueue_mem_total(void);
 void chunkqueue_chunk_pool_free(void);
 
 __attribute_returns_nonnull__
 chunkqueue *chunkqueue_init(chunkqueue *cq);
 
 void chunkqueue_set_chunk_size (size_t sz);
+void chunkqueue_set_ring (chunkqueue *cq);
 void chunkqueue_set_tempdirs_default_reset (void);
 void chunkqueue_set_tempdirs_default (const array *tempdirs, off_t upload_temp_file_size);
 void chunkqueue_set_tempdirs(chunkqueue * restrict cq, const array * restrict tempdirs, off_t upload_temp_file_size);
@@ -136,6 +154,10 @@ static inline off_t chunkqueue_length(const chunkqueue *cq) {
 	return cq->bytes_in - cq->bytes_out;
 }
 
+/* bytes of unsent data in MEM_CHUNKs in chunkqueue */
+__attribute_pure__
+off_t chunkqueue_length_mem(const chunkqueue *cq);
+
 __attribute_cold__
 void chunkqueue_free(chunkqueue *cq);
 
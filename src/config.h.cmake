@@ -15,6 +15,7 @@
 /* System */
 #cmakedefine  HAVE_SYS_DEVPOLL_H
 #cmakedefine  HAVE_SYS_EPOLL_H
+#cmakedefine  HAVE_LINUX_IO_URING_H
 #cmakedefine  HAVE_SYS_EVENT_H
 #cmakedefine  HAVE_SYS_LOADAVG_H
 #cmakedefine  HAVE_SYS_MMAN_H
@@ -125,15 +126,19 @@
 #cmakedefine  HAVE_LOCALTIME_R
 #cmakedefine  HAVE_LSTAT
 #cmakedefine  HAVE_MADVISE
+#cmakedefine  HAVE_MALLINFO2
+#cmakedefine  HAVE_MALLOC_TRIM
 #cmakedefine  HAVE_MEMCPY
 #cmakedefine  HAVE_MEMSET
 #cmakedefine  HAVE_MMAP
 #cmakedefine  HAVE_PATHCONF
+#cmakedefine  HAVE_PIPE2
 #cmakedefine  HAVE_POLL
 #cmakedefine  HAVE_PORT_CREATE
 #cmakedefine  HAVE_PRCTL
 #cmakedefine  HAVE_PREAD
 #cmakedefine  HAVE_POSIX_FADVISE
+#cmakedefine  HAVE_SCHED_SETAFFINITY
 #cmakedefine  HAVE_SELECT
 #cmakedefine  HAVE_SENDFILE
 #cmakedefine  HAVE_SEND_FILE
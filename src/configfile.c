@@ -675,6 +675,48 @@ static int config_insert_srvconf(server *srv) {
      ,{ CONST_STR_LEN("server.feature-flags"),
         T_CONFIG_ARRAY_KVANY,
         T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.accept-batch"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.cpu-affinity"),
+        T_CONFIG_ARRAY_VLIST,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.reuseport-bpf"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.busy-poll"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.upgrade-socket"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.upgrade-warmup"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.zerocopy-threshold"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.aio-threads"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.global-kbytes-per-second"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.mmap-cache-size"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.tcp-notsent-lowat"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.max-request-mem"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.max-connection-mem"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.max-mem"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -823,6 +865,64 @@ static int config_insert_srvconf(server *srv) {
                     array_get_element_klen(cpv->v.a,
                       CONST_STR_LEN("server.absolute-dir-redirect")), 0);
                 break;
+              case 34:/* server.accept-batch */
+                srv->srvconf.accept_batch = cpv->v.shrt ? cpv->v.shrt : 1;
+                break;
+              case 35:/* server.cpu-affinity */
+                srv->srvconf.cpu_affinity = cpv->v.a;
+                break;
+              case 36:/* server.reuseport-bpf */
+                srv->srvconf.reuseport_bpf = (0 != cpv->v.u);
+                break;
+              case 37:/* server.busy-poll */
+                if (cpv->v.u > 1000000) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "server.busy-poll (usec) must be <= 1000000: %u",
+                      cpv->v.u);
+                    rc = HANDLER_ERROR;
+                    break;
+                }
+                srv->srvconf.busy_poll = cpv->v.u;
+                break;
+              case 38:/* server.upgrade-socket */
+                if (!buffer_string_is_empty(cpv->v.b)) {
+                    if (cpv->v.b->ptr[0] != '/') {
+                        log_error(srv->errh, __FILE__, __LINE__,
+                          "server.upgrade-socket must be an absolute path: %s",
+                          cpv->v.b->ptr);
+                        rc = HANDLER_ERROR;
+                        break;
+                    }
+                    srv->srvconf.upgrade_socket = cpv->v.b;
+                }
+                break;
+              case 39:/* server.upgrade-warmup */
+                srv->srvconf.upgrade_warmup = cpv->v.shrt;
+                break;
+              case 40:/* server.zerocopy-threshold */
+                srv->srvconf.zerocopy_threshold = cpv->v.u;
+                break;
+              case 41:/* server.aio-threads */
+                srv->srvconf.aio_threads = cpv->v.shrt;
+                break;
+              case 42:/* server.global-kbytes-per-second */
+                srv->bytes_per_second_cnt[1] = (off_t)cpv->v.u << 10;
+                break;
+              case 43:/* server.mmap-cache-size */
+                stat_cache_mmap_budget((size_t)cpv->v.u << 20); /* MB */
+                break;
+              case 44:/* server.tcp-notsent-lowat */
+                srv->srvconf.tcp_notsent_lowat = cpv->v.u;
+                break;
+              case 45:/* server.max-request-mem */
+                srv->srvconf.max_request_mem = cpv->v.u << 10; /* kb */
+                break;
+              case 46:/* server.max-connection-mem */
+                srv->srvconf.max_connection_mem = cpv->v.u << 10; /* kb */
+                break;
+              case 47:/* server.max-mem */
+                srv->srvconf.max_mem = (off_t)cpv->v.u << 20; /* MB */
+                break;
               default:/* should not happen */
                 break;
             }
@@ -1023,9 +1123,9 @@ static int config_insert(server *srv) {
                     cpv->v.shrt |=FDEVENT_STREAM_RESPONSE;
                 break;
               case 18:{/*server.kbytes-per-second */
-                off_t * const cnt = malloc(2*sizeof(off_t));
+                /*(see connection_write_share() for cnt[] layout)*/
+                off_t * const cnt = calloc(5, sizeof(off_t));
                 force_assert(cnt);
-                cnt[0] = 0;
                 cnt[1] = (off_t)cpv->v.shrt << 10;
                 cpv->v.v = cnt;
                 cpv->vtype = T_CONFIG_LOCAL;
@@ -1169,6 +1269,7 @@ void config_init(server *srv) {
 
     srv->srvconf.high_precision_timestamps = 0;
     srv->srvconf.max_request_field_size = 8192;
+    srv->srvconf.accept_batch = 100;
 
     srv->srvconf.http_header_strict  = 1;
     srv->srvconf.http_host_strict    = 1; /*(implies http_host_normalize)*/
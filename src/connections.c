@@ -1,6 +1,7 @@
 #include "first.h"
 
 #include "base.h"
+#include "aio_prefetch.h"
 #include "buffer.h"
 #include "burl.h"       /* HTTP_PARSEOPT_HEADER_STRICT */
 #include "chunk.h"
@@ -14,9 +15,11 @@
 #include "request.h"
 #include "response.h"
 #include "network.h"
+#include "network_write.h"
 #include "stat_cache.h"
 
 #include "plugin.h"
+#include "status_counter.h"
 
 #include "inet_ntop_cache.h"
 
@@ -33,6 +36,14 @@
 
 #include "sys-socket.h"
 
+#if defined(__linux__) && defined(TCP_INFO) && defined(TCP_NOTSENT_LOWAT)
+#include <sys/ioctl.h>
+#include <linux/sockios.h>  /* SIOCOUTQNSD */
+#ifdef SIOCOUTQNSD
+#define CONNECTION_WRITE_BUDGET_ADAPTIVE
+#endif
+#endif
+
 #define HTTP_LINGER_TIMEOUT 5
 
 #define connection_set_state(r, n) ((r)->state = (n))
@@ -67,12 +78,156 @@ static connection *connections_get_new_connection(server *srv) {
 	return conns->ptr[conns->used++];
 }
 
+/* hierarchical timer wheel for connection timeout checks
+ *
+ * Each active connection is scheduled at the time of its earliest possible
+ * timeout (tw_ts) given its current state and timestamps.  Timestamps only
+ * move forward with activity, so a connection checked at tw_ts either has
+ * timed out or is rescheduled for its later deadline.  Connections are
+ * rescheduled at the end of connection_state_machine(), where the state
+ * changes that might shorten a deadline occur.
+ *
+ * level 0: CONN_TW_SIZE slots of 1 sec
+ * level 1: CONN_TW_SIZE slots of CONN_TW_SIZE secs
+ * (deadlines further out are clamped to the wheel horizon and rechecked) */
+
+#define CONN_TW_BITS 6
+#define CONN_TW_SIZE (1u << CONN_TW_BITS)
+#define CONN_TW_MASK (CONN_TW_SIZE - 1)
+#define CONN_TW_HORIZON ((time_t)(CONN_TW_SIZE * CONN_TW_SIZE - 1))
+
+static struct {
+    connection *slot[2][CONN_TW_SIZE];
+    uint32_t used[2];
+    uint32_t checks;
+    time_t ts; /* next tick to be processed */
+} conn_tw;
+
+static uint64_t conn_requests; /* HTTP/1.x requests (fdevent ctl stats) */
+
+static void connection_tw_unlink (connection * const con) {
+    const time_t ts = con->tw_ts;
+    if (0 == ts) return;
+    if (con->tw_prev)
+        con->tw_prev->tw_next = con->tw_next;
+    else
+        conn_tw.slot[con->tw_lvl][con->tw_lvl
+                                  ? (ts >> CONN_TW_BITS) & CONN_TW_MASK
+                                  : ts & CONN_TW_MASK] = con->tw_next;
+    if (con->tw_next)
+        con->tw_next->tw_prev = con->tw_prev;
+    --conn_tw.used[con->tw_lvl];
+    con->tw_next = NULL;
+    con->tw_prev = NULL;
+    con->tw_ts = 0;
+}
+
+static void connection_tw_link (connection * const con, time_t ts) {
+    if (0 == conn_tw.ts) conn_tw.ts = log_epoch_secs;
+    if (ts < conn_tw.ts) ts = conn_tw.ts;
+    if (ts - conn_tw.ts > CONN_TW_HORIZON) ts = conn_tw.ts + CONN_TW_HORIZON;
+    const int lvl = (ts - conn_tw.ts >= (time_t)CONN_TW_SIZE);
+    connection ** const slot = lvl
+      ? &conn_tw.slot[1][(ts >> CONN_TW_BITS) & CONN_TW_MASK]
+      : &conn_tw.slot[0][ts & CONN_TW_MASK];
+    con->tw_ts = ts;
+    con->tw_lvl = lvl;
+    con->tw_prev = NULL;
+    con->tw_next = *slot;
+    if (*slot) (*slot)->tw_prev = con;
+    *slot = con;
+    ++conn_tw.used[lvl];
+}
+
+/* secs a keep-alive connection is idle before its request memory is released
+ * (not released immediately at end of response since the next request often
+ *  follows shortly and would reallocate the same buffers and arrays) */
+#define CONNECTION_IDLE_RELEASE 1
+
+static int connection_is_idle (const connection * const con) {
+    /* HTTP/1.x keep-alive connection waiting for next request */
+    return con->request_count > 1
+        && con->request.state == CON_STATE_READ
+        && chunkqueue_is_empty(con->read_queue);
+}
+
+static void connection_release_idle (connection * const con) {
+    /* release buffers, header arrays and request arena of an idle keep-alive
+     * connection; reacquired on demand when the next request is read.
+     * (TLS modules release TLS record buffers when idle, where supported,
+     *  e.g. SSL_MODE_RELEASE_BUFFERS, and con->read_queue is empty, so no
+     *  chunks are held) */
+    request_reset_idle(&con->request);
+    con->idle_released = 1;
+    status_counter_inc(CONST_STR_LEN("connections.idle-released"));
+}
+
+static time_t connection_tw_deadline (const connection * const con) {
+    /* earliest time at which connection_check_timeout() might take action
+     * (timeouts trigger when (cur_ts - ts > limit), i.e. at ts + limit + 1) */
+    const request_st * const r = &con->request;
+    time_t ts = log_epoch_secs + CONN_TW_HORIZON;
+
+    /* bytes_written_cur_second and traffic limits reset each second */
+    if (con->traffic_limit_reached || con->bytes_written_cur_second)
+        return log_epoch_secs + 1;
+
+    if (r->state == CON_STATE_CLOSE)
+        return con->close_timeout_ts + HTTP_LINGER_TIMEOUT + 1;
+    else if (con->h2 && r->state == CON_STATE_WRITE) {
+        const h2con * const h2c = con->h2;
+        if (0 == h2c->rused)
+            return con->read_idle_ts + con->keep_alive_idle + 1;
+        for (uint32_t i = 0; i < h2c->rused; ++i) {
+            const request_st * const rr = h2c->r[i];
+            if (rr->state == CON_STATE_ERROR)
+                return log_epoch_secs + 1;
+            if (rr->reqbody_length != rr->reqbody_queue.bytes_in) {
+                const time_t t = con->read_idle_ts + rr->conf.max_read_idle + 1;
+                if (ts > t) ts = t;
+            }
+            if (rr->state != CON_STATE_READ_POST && con->write_request_ts) {
+                const time_t t = con->write_request_ts+r->conf.max_write_idle+1;
+                if (ts > t) ts = t;
+            }
+        }
+        return ts;
+    }
+    else if (fdevent_fdnode_interest(con->fdn) & FDEVENT_IN) {
+        ts = con->read_idle_ts + 1
+           + ((con->request_count == 1 || r->state != CON_STATE_READ)
+              ? r->conf.max_read_idle
+              : connection_is_idle(con) && !con->idle_released
+              ? CONNECTION_IDLE_RELEASE
+              : con->keep_alive_idle);
+    }
+
+    if (r->http_version <= HTTP_VERSION_1_1
+        && r->state == CON_STATE_WRITE && con->write_request_ts != 0) {
+        const time_t t = con->write_request_ts + r->conf.max_write_idle + 1;
+        if (ts > t) ts = t;
+    }
+
+    return ts;
+}
+
+static void connection_tw_sched (connection * const con) {
+    time_t ts = connection_tw_deadline(con);
+    if (ts < conn_tw.ts) ts = conn_tw.ts;
+    if (ts - conn_tw.ts > CONN_TW_HORIZON) ts = conn_tw.ts + CONN_TW_HORIZON;
+    if (ts == con->tw_ts) return;
+    connection_tw_unlink(con);
+    connection_tw_link(con, ts);
+}
+
 static void connection_del(server *srv, connection *con) {
 	connections * const conns = &srv->conns;
 
 	if (-1 == con->ndx) return;
 	uint32_t i = (uint32_t)con->ndx;
 
+	connection_tw_unlink(con);
+
 	/* not last element */
 
 	if (i != --conns->used) {
@@ -109,13 +264,20 @@ static void connection_close(connection *con) {
 	con->is_ssl_sock = 0;
 	con->revents_err = 0;
 
+	if (con->aio_job) {
+		aio_prefetch_cancel(con->aio_job);
+		con->aio_job = NULL;
+	}
+
 	fdevent_fdnode_event_del(srv->ev, con->fdn);
 	fdevent_unregister(srv->ev, con->fd);
 	con->fdn = NULL;
+	if (network_write_zerocopy_close(con->fd))
+		; /*(fd closed later, once MSG_ZEROCOPY sends complete)*/
 #ifdef __WIN32
-	if (0 == closesocket(con->fd))
+	else if (0 == closesocket(con->fd))
 #else
-	if (0 == close(con->fd))
+	else if (0 == close(con->fd))
 #endif
 		--srv->cur_fds;
 	else
@@ -231,6 +393,7 @@ static void connection_handle_response_end_state(request_st * const r, connectio
         if (r->keep_alive) {
 		request_reset(r);
 		config_reset_config(r);
+		con->idle_released = 0; /* see connection_release_idle() */
 		con->is_readable = 1; /* potentially trigger optimistic read */
 		/*(accounting used by mod_accesslog for HTTP/1.0 and HTTP/1.1)*/
 		r->bytes_read_ckpt = con->bytes_read;
@@ -245,17 +408,66 @@ static void connection_handle_response_end_state(request_st * const r, connectio
 }
 
 
-__attribute_pure__
+/* min bytes granted to a connection from a shared bucket per loop iteration
+ * (e.g. so that small responses complete without waiting for many turns) */
+#define CONNECTION_WRITE_QUANTUM 16384
+
+static off_t
+connection_write_share (off_t * const restrict cnt, const uint32_t iter)
+{
+    /* token bucket shared by connections (server.kbytes-per-second or
+     * server.global-kbytes-per-second): bytes remaining in current second
+     * are divided among connections writing in each event loop iteration,
+     * so that a few large downloads do not consume the whole budget before
+     * other connections are serviced.  The number of writers in the previous
+     * iteration is used, since writers in current iteration are not known
+     * until each has been serviced.
+     * cnt[0] bytes written in current second
+     * cnt[1] limit (bytes/sec)
+     * cnt[2] loop iteration
+     * cnt[3] writers in current iteration
+     * cnt[4] writers in previous iteration */
+    off_t avail = cnt[1] - cnt[0];
+    if (avail <= 0) return 0;
+    if (cnt[2] != (off_t)iter) {
+        cnt[2] = (off_t)iter;
+        cnt[4] = cnt[3];
+        cnt[3] = 0;
+    }
+    ++cnt[3];
+    if (cnt[4] > 1) {
+        off_t share = avail / cnt[4];
+        if (share < CONNECTION_WRITE_QUANTUM)
+            share = CONNECTION_WRITE_QUANTUM;
+        if (avail > share)
+            avail = share;
+    }
+    return avail;
+}
+
+
 static off_t
-connection_write_throttled (const connection * const con, off_t max_bytes)
+connection_write_throttled (connection * const con, off_t max_bytes)
 {
     const request_config * const restrict rconf = &con->request.conf;
-    if (0 == rconf->global_bytes_per_second && 0 == rconf->bytes_per_second)
+    server * const srv = con->srv;
+    if (0 == rconf->global_bytes_per_second && 0 == rconf->bytes_per_second
+        && 0 == srv->bytes_per_second_cnt[1])
         return max_bytes;
 
+    /* hierarchical limits: server-wide, then scope, then connection */
+
+    if (srv->bytes_per_second_cnt[1]) {
+        off_t limit =
+          connection_write_share(srv->bytes_per_second_cnt, srv->loop_iter);
+        if (max_bytes > limit)
+            max_bytes = limit;
+    }
+
     if (rconf->global_bytes_per_second) {
-        off_t limit = (off_t)rconf->global_bytes_per_second
-                    - *(rconf->global_bytes_per_second_cnt_ptr);
+        off_t limit =
+          connection_write_share(rconf->global_bytes_per_second_cnt_ptr,
+                                 srv->loop_iter);
         if (max_bytes > limit)
             max_bytes = limit;
     }
@@ -281,6 +493,79 @@ connection_write_throttle (connection * const con, off_t max_bytes)
 }
 
 
+static off_t
+connection_write_budget (const connection * const con)
+{
+  #ifdef CONNECTION_WRITE_BUDGET_ADAPTIVE
+    /* server.tcp-notsent-lowat: size each write from TCP send queue state:
+     * target twice one congestion window (or twice lowat, if larger) of data
+     * not yet sent, less data already queued in kernel and not yet sent.
+     * Fast clients (large cwnd) get larger writes than MAX_WRITE_LIMIT, while
+     * slow clients do not accumulate large kernel send queues, and HTTP/2
+     * frames are staged closer to when they can be sent.  POLLOUT is not
+     * reported until unsent data drops below lowat (TCP_NOTSENT_LOWAT) */
+    const off_t lowat = (off_t)con->srv->srvconf.tcp_notsent_lowat;
+    if (0 == lowat) return MAX_WRITE_LIMIT;
+    const int sa_family = sock_addr_get_family(&con->srv_socket->addr);
+    if (sa_family != AF_INET && sa_family != AF_INET6) return MAX_WRITE_LIMIT;
+
+    struct tcp_info tcpi;
+    socklen_t tlen = sizeof(tcpi);
+    int notsent;
+    if (0 != getsockopt(con->fd, IPPROTO_TCP, TCP_INFO, &tcpi, &tlen)
+        || 0 != ioctl(con->fd, SIOCOUTQNSD, &notsent))
+        return MAX_WRITE_LIMIT;
+
+    off_t target = (off_t)tcpi.tcpi_snd_cwnd * tcpi.tcpi_snd_mss;
+    if (target < lowat) target = lowat;
+    target <<= 1;
+    if (target > (MAX_WRITE_LIMIT << 2)) target = (MAX_WRITE_LIMIT << 2);
+    target -= notsent;
+    return target > CONNECTION_WRITE_QUANTUM
+      ? target
+      : CONNECTION_WRITE_QUANTUM;
+  #else
+    UNUSED(con);
+    return MAX_WRITE_LIMIT;
+  #endif
+}
+
+
+static void
+connection_aio_prefetch_done (void *ctx)
+{
+    connection * const con = ctx;
+    con->aio_job = NULL;
+    con->is_writable = 1;
+    joblist_append(con);
+}
+
+
+static off_t
+connection_aio_prefetch (connection * const con, chunkqueue * const cq, off_t max_bytes)
+{
+    /* limit write to data preceding FILE_CHUNK if FILE_CHUNK data is not in
+     * page cache; resume when helper thread has read ahead the file data */
+    if (con->aio_job) return 0;
+    off_t len = 0;
+    for (chunk *c = cq->first; NULL != c && len < max_bytes; c = c->next) {
+        if (c->type == MEM_CHUNK) {
+            len += (off_t)buffer_string_length(c->mem) - c->offset;
+            continue;
+        }
+        if (c->file.fd < 0 && c == cq->first
+            && 0 != chunkqueue_open_file_chunk(cq, con->request.conf.errh))
+            break; /*(error handled in con->network_write())*/
+        off_t n = c->file.length - c->offset;
+        if (n > max_bytes - len) n = max_bytes - len;
+        con->aio_job =
+          aio_prefetch_chunk(c, n, connection_aio_prefetch_done, con);
+        return con->aio_job ? len : max_bytes;
+    }
+    return max_bytes;
+}
+
+
 static int
 connection_write_chunkqueue (connection * const con, chunkqueue * const restrict cq, off_t max_bytes)
 {
@@ -291,6 +576,14 @@ connection_write_chunkqueue (connection * const con, chunkqueue * const restrict
     max_bytes = connection_write_throttle(con, max_bytes);
     if (0 == max_bytes) return 1;
 
+    if (con->srv->srvconf.aio_threads) {
+        max_bytes = connection_aio_prefetch(con, cq, max_bytes);
+        if (0 == max_bytes) {
+            con->is_writable = 0; /*(until aio_prefetch job completes)*/
+            return 1;
+        }
+    }
+
     off_t written = cq->bytes_out;
     int ret;
 
@@ -311,8 +604,13 @@ connection_write_chunkqueue (connection * const con, chunkqueue * const restrict
       #ifdef TCP_CORK
         /* Linux: put a cork into socket as we want to combine write() calls
          * but only if we really have multiple chunks including non-MEM_CHUNK
-         * (or if multiple chunks and TLS), and only if TCP socket */
-        if (NULL != c || con->is_ssl_sock) {
+         * (or if multiple chunks and TLS), and only if TCP socket
+         * (not needed if network backend coalesces MEM_CHUNK(s) followed by
+         *  FILE_CHUNK using MSG_MORE, unless more chunks follow FILE_CHUNK) */
+        if (NULL != c
+              ? (NULL != c->next || !con->srv->network_backend_more
+                 || con->is_ssl_sock)
+              : con->is_ssl_sock) {
             const int sa_family = sock_addr_get_family(&con->srv_socket->addr);
             if (sa_family == AF_INET || sa_family == AF_INET6) {
                 corked = 1;
@@ -342,6 +640,13 @@ connection_write_chunkqueue (connection * const con, chunkqueue * const restrict
     request_st * const r = &con->request;
     if (r->conf.global_bytes_per_second_cnt_ptr)
         *(r->conf.global_bytes_per_second_cnt_ptr) += written;
+    if (con->srv->bytes_per_second_cnt[1])
+        con->srv->bytes_per_second_cnt[0] += written;
+
+    /* edge-triggered: write stopped at max_bytes rather than at EAGAIN,
+     * so no edge will be reported for socket which is still writable */
+    if (1 == ret && written >= max_bytes && con->srv->srvconf.edge_triggered)
+        ret = 2;
 
     return ret;
 }
@@ -363,6 +668,8 @@ connection_write_1xx_info (request_st * const r, connection * const con)
     con->bytes_written_cur_second += written;
     if (r->conf.global_bytes_per_second_cnt_ptr)
         *(r->conf.global_bytes_per_second_cnt_ptr) += written;
+    if (con->srv->bytes_per_second_cnt[1])
+        con->srv->bytes_per_second_cnt[0] += written;
 
     if (rc < 0) {
         connection_set_state_error(r, CON_STATE_ERROR);
@@ -454,7 +761,8 @@ static int connection_handle_write(request_st * const r, connection * const con)
 	/*assert(!chunkqueue_is_empty(cq));*//* checked by callers */
 
 	if (!con->is_writable) return CON_STATE_WRITE;
-	int rc = connection_write_chunkqueue(con, con->write_queue, MAX_WRITE_LIMIT);
+	int rc = connection_write_chunkqueue(con, con->write_queue,
+	                                     connection_write_budget(con));
 	switch (rc) {
 	case 0:
 		if (r->resp_body_finished) {
@@ -472,12 +780,16 @@ static int connection_handle_write(request_st * const r, connection * const con)
 		return CON_STATE_ERROR;
 	case 1:
 		/* do not spin trying to send HTTP/2 server Connection Preface
-		 * while waiting for TLS negotiation to complete */
-		if (con->write_queue->bytes_out)
+		 * while waiting for TLS negotiation to complete
+		 * (and do not spin if throttled before anything was sent) */
+		if (con->write_queue->bytes_out || con->traffic_limit_reached)
 			con->is_writable = 0;
 
 		/* not finished yet -> WRITE */
 		break;
+	case 2: /* (edge-triggered) socket still writable; reschedule */
+		joblist_append(con);
+		break;
 	}
 
 	return CON_STATE_WRITE; /*(state did not change)*/
@@ -550,6 +862,7 @@ static connection *connection_init(server *srv) {
 	config_reset_config(r);
 	con->write_queue = &r->write_queue;
 	con->read_queue = &r->read_queue;
+	chunkqueue_set_ring(con->read_queue);
 
 	/* init plugin-specific per-connection structures */
 	con->plugin_ctx = calloc(1, (srv->plugins.used + 1) * sizeof(void *));
@@ -580,6 +893,7 @@ void connections_free(server *srv) {
 
 	free(conns->ptr);
 	conns->ptr = NULL;
+	memset(&conn_tw, 0, sizeof(conn_tw));
 }
 
 
@@ -626,7 +940,7 @@ static chunk * connection_read_header_more(connection *con, chunkqueue *cq, chun
 
     if (cq->first != cq->last && 0 != olen) {
         const size_t clen = chunkqueue_length(cq);
-        size_t block = (olen + (16384-1)) & (16384-1);
+        size_t block = (olen + (16384-1)) & ~(size_t)(16384-1);
         block += (block - olen > 1024 ? 0 : 16384);
         chunkqueue_compact_mem(cq, block > clen ? clen : block);
     }
@@ -817,12 +1131,16 @@ static int connection_handle_read_state(connection * const con)  {
 }
 
 
-static handler_t connection_handle_fdevent(void * const context, const int revents) {
+static handler_t connection_handle_fdevent(void * const context, int revents) {
     connection * restrict con = context;
     const int is_ssl_sock = con->is_ssl_sock;
 
     joblist_append(con);
 
+    /* MSG_ZEROCOPY completion notifications on socket error queue */
+    if ((revents & FDEVENT_ERR) && network_write_zerocopy_notify(con->fd))
+        revents &= ~FDEVENT_ERR;
+
     if (revents & ~(FDEVENT_IN | FDEVENT_OUT))
         con->revents_err |= (revents & ~(FDEVENT_IN | FDEVENT_OUT));
 
@@ -878,6 +1196,7 @@ connection *connection_accept(server *srv, server_socket *srv_socket) {
 	} else {
 		if (sock_addr_get_family(&cnt_addr) != AF_UNIX) {
 			network_accept_tcp_nagle_disable(cnt);
+			network_write_zerocopy_accept(cnt);
 		}
 		return connection_accepted(srv, srv_socket, &cnt_addr, cnt);
 	}
@@ -1022,6 +1341,7 @@ connection *connection_accepted(server *srv, server_socket *srv_socket, sock_add
 			return NULL;
 		}
 		if (r->http_status < 0) connection_set_state(r, CON_STATE_WRITE);
+		connection_tw_link(con, log_epoch_secs + 1);
 		return con;
 }
 
@@ -1070,6 +1390,7 @@ connection_state_machine_loop (request_st * const r, connection * const con)
 				log_clock_gettime_realtime(&r->start_hp);
 
 			con->request_count++;
+			++conn_requests;
 			r->loops_per_request = 0;
 
 			connection_set_state(r, CON_STATE_READ);
@@ -1222,7 +1543,8 @@ connection_set_fdevent_interest (request_st * const r, connection * const con)
         break;
       case CON_STATE_WRITE:
         if (!chunkqueue_is_empty(con->write_queue)
-            && 0 == con->is_writable && 0 == con->traffic_limit_reached)
+            && 0 == con->is_writable && 0 == con->traffic_limit_reached
+            && NULL == con->aio_job)
             n |= FDEVENT_OUT;
         __attribute_fallthrough__
       case CON_STATE_READ_POST:
@@ -1251,6 +1573,14 @@ connection_set_fdevent_interest (request_st * const r, connection * const con)
     }
     if (events & FDEVENT_RDHUP)
         n |= FDEVENT_RDHUP;
+    if (con->srv->srvconf.edge_triggered) {
+        n |= FDEVENT_ET;
+        /* no further edge is reported for data already pending if read
+         * stopped short of EAGAIN (max_bytes) or if readiness was reported
+         * while FDEVENT_IN was not of interest; reschedule to drain socket */
+        if ((n & FDEVENT_IN) && con->is_readable > 0)
+            joblist_append(con);
+    }
 
     if (n == events) return;
 
@@ -1293,7 +1623,7 @@ connection_state_machine_h2 (request_st * const h2r, connection * const con)
          * even though we are not calculating response HEADERS frames
          * or frame overhead here */
         off_t max_bytes = con->is_writable
-          ? connection_write_throttle(con, MAX_WRITE_LIMIT)
+          ? connection_write_throttle(con, connection_write_budget(con))
           : 0;
         const off_t fsize = (off_t)h2c->s_max_frame_size;
 
@@ -1432,6 +1762,8 @@ connection_state_machine (connection * const con)
         connection_state_machine_h2(r, con);
     else /* if (r->http_version <= HTTP_VERSION_1_1) */
         connection_state_machine_h1(r, con);
+
+    if (-1 != con->ndx) connection_tw_sched(con);
 }
 
 
@@ -1536,6 +1868,10 @@ static void connection_check_timeout (connection * const con, const time_t cur_t
                 connection_set_state_error(r, CON_STATE_ERROR);
                 changed = 1;
             }
+            else if (!con->idle_released && connection_is_idle(con)
+                     && cur_ts - con->read_idle_ts > CONNECTION_IDLE_RELEASE) {
+                connection_release_idle(con);
+            }
         }
     }
 
@@ -1592,12 +1928,68 @@ static void connection_check_timeout (connection * const con, const time_t cur_t
     }
 }
 
-void connection_periodic_maint (server * const srv, const time_t cur_ts) {
-    /* check all connections for timeouts */
+__attribute_cold__
+__attribute_noinline__
+static void connection_periodic_maint_all (server * const srv, const time_t cur_ts) {
+    /* check all connections for timeouts
+     * (and reschedule all in timer wheel, e.g. after system clock change) */
     connections * const conns = &srv->conns;
-    for (size_t ndx = 0; ndx < conns->used; ++ndx) {
-        connection_check_timeout(conns->ptr[ndx], cur_ts);
+    for (uint32_t ndx = 0; ndx < conns->used; ++ndx)
+        connection_tw_unlink(conns->ptr[ndx]);
+    conn_tw.ts = cur_ts + 1;
+    for (uint32_t ndx = 0; ndx < conns->used; ++ndx) {
+        connection * const con = conns->ptr[ndx];
+        connection_check_timeout(con, cur_ts);
+        if (-1 == con->ndx)
+            --ndx; /* con closed; last active con was swapped into ptr[ndx] */
+        else if (0 == con->tw_ts)
+            connection_tw_sched(con);
+    }
+    conn_tw.checks = conns->used;
+}
+
+void connection_periodic_maint (server * const srv, const time_t cur_ts) {
+    /* check connections scheduled in timer wheel for timeouts */
+    if (0 == conn_tw.ts) conn_tw.ts = cur_ts;
+    if (cur_ts - conn_tw.ts >= CONN_TW_HORIZON || cur_ts + 1 < conn_tw.ts)
+        connection_periodic_maint_all(srv, cur_ts);
+    else {
+        conn_tw.checks = 0;
+        for (time_t t = conn_tw.ts; t <= cur_ts; ++t) {
+            if (0 == (t & CONN_TW_MASK)) {
+                /* cascade level 1 slot into level 0 */
+                connection **slot =
+                  &conn_tw.slot[1][(t >> CONN_TW_BITS) & CONN_TW_MASK];
+                for (connection *con; (con = *slot); ) {
+                    const time_t ts = con->tw_ts;
+                    connection_tw_unlink(con);
+                    connection_tw_link(con, ts);
+                }
+            }
+            conn_tw.ts = t + 1;
+            connection **slot = &conn_tw.slot[0][t & CONN_TW_MASK];
+            for (connection *con; (con = *slot); ) {
+                connection_tw_unlink(con);
+                connection_check_timeout(con, cur_ts);
+                if (-1 != con->ndx && 0 == con->tw_ts) connection_tw_sched(con);
+                ++conn_tw.checks;
+            }
+        }
     }
+
+    status_counter_set(CONST_STR_LEN("connections.timer-wheel.level0"),
+                       (int)conn_tw.used[0]);
+    status_counter_set(CONST_STR_LEN("connections.timer-wheel.level1"),
+                       (int)conn_tw.used[1]);
+    status_counter_set(CONST_STR_LEN("connections.timer-wheel.checks"),
+                       (int)conn_tw.checks);
+
+    const uint64_t ctl_calls = fdevent_ctl_calls(srv->ev);
+    status_counter_set(CONST_STR_LEN("fdevent.ctl-calls"), (int)ctl_calls);
+    status_counter_set(CONST_STR_LEN("fdevent.ctl-calls-per-100-requests"),
+                       conn_requests
+                       ? (int)(ctl_calls * 100 / conn_requests)
+                       : 0);
 }
 
 void connection_graceful_shutdown_maint (server *srv) {
@@ -33,6 +33,10 @@ int fdevent_config(const char **event_handler_name, log_error_st *errh) {
 		{ FDEVENT_HANDLER_LINUX_SYSEPOLL, "linux-sysepoll" },
 		{ FDEVENT_HANDLER_LINUX_SYSEPOLL, "epoll" },
 #endif
+#ifdef FDEVENT_USE_LINUX_IOURING
+		{ FDEVENT_HANDLER_LINUX_IOURING,  "linux-iouring" },
+		{ FDEVENT_HANDLER_LINUX_IOURING,  "io_uring" },
+#endif
 #ifdef FDEVENT_USE_SOLARIS_PORT
 		{ FDEVENT_HANDLER_SOLARIS_PORT,   "solaris-eventports" },
 #endif
@@ -114,6 +118,11 @@ const char * fdevent_show_event_handlers(void) {
 #else
       "\t- epoll (Linux)\n"
 #endif
+#ifdef FDEVENT_USE_LINUX_IOURING
+      "\t+ io_uring (Linux)\n"
+#else
+      "\t- io_uring (Linux)\n"
+#endif
 #ifdef FDEVENT_USE_SOLARIS_DEVPOLL
       "\t+ /dev/poll (Solaris)\n"
 #else
@@ -211,6 +220,11 @@ fdevents * fdevent_init(const char *event_handler, int *max_fds, int *cur_fds, l
 		if (0 == fdevent_linux_sysepoll_init(ev)) return ev;
 		break;
 	#endif
+	#ifdef FDEVENT_USE_LINUX_IOURING
+	case FDEVENT_HANDLER_LINUX_IOURING:
+		if (0 == fdevent_linux_iouring_init(ev)) return ev;
+		break;
+	#endif
 	#ifdef FDEVENT_USE_SOLARIS_DEVPOLL
 	case FDEVENT_HANDLER_SOLARIS_DEVPOLL:
 		if (0 == fdevent_solaris_devpoll_init(ev)) return ev;
@@ -273,6 +287,35 @@ int fdevent_reset(fdevents *ev) {
 	return rc;
 }
 
+int fdevent_features(const fdevents *ev) {
+	return ev->features;
+}
+
+uint64_t fdevent_ctl_calls(const fdevents *ev) {
+	return ev->ctl_calls;
+}
+
+uint64_t fdevent_clock_usec(void) {
+	struct timespec ts;
+      #if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+      #else
+	log_clock_gettime_realtime(&ts);
+      #endif
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void fdevent_track_wake(fdevents *ev, int enable) {
+	/* record (in backend poll) time of wake prior to dispatching events
+	 * (not supported by libev; fdevent_wake_ts() returns 0) */
+	ev->track_wake = (0 != enable);
+	ev->wake_ts = 0;
+}
+
+uint64_t fdevent_wake_ts(const fdevents *ev) {
+	return ev->wake_ts;
+}
+
 static fdnode *fdnode_init(void) {
 	return calloc(1, sizeof(fdnode));
 }
@@ -374,6 +417,7 @@ static int fdevent_fdnode_event_unsetter_retry(fdevents *ev, fdnode *fdn) {
 
 static void fdevent_fdnode_event_unsetter(fdevents *ev, fdnode *fdn) {
     if (-1 == fdn->fde_ndx) return;
+    ++ev->ctl_calls;
     if (0 != ev->event_del(ev, fdn))
         fdevent_fdnode_event_unsetter_retry(ev, fdn);
     fdn->fde_ndx = -1;
@@ -412,6 +456,19 @@ static void fdevent_fdnode_event_setter(fdevents *ev, fdnode *fdn, int events) {
      * then FDEVENT_HUP or FDEVENT_ERR will never be returned.) */
     if (fdn->events == events) return;/*(no change; nothing to do)*/
 
+    /* FDEVENT_ET: fd is registered once for all events, edge-triggered, and
+     * only the interest recorded in fdn->events changes.  Caller is expected
+     * to read until EAGAIN (or to reschedule itself if it stops short).
+     * Re-arm when FDEVENT_OUT is (re)requested, since caller may have stopped
+     * writing (e.g. max_bytes) before filling the kernel socket send buffer,
+     * in which case no further edge would be reported */
+    if ((events & fdn->events & FDEVENT_ET)
+        && !(events & ~fdn->events & FDEVENT_OUT)) {
+        fdn->events = events;
+        return;
+    }
+
+    ++ev->ctl_calls;
     if (0 == ev->event_set(ev, fdn, events)
         || fdevent_fdnode_event_setter_retry(ev, fdn, events))
         fdn->events = events;
@@ -34,6 +34,9 @@ struct fdnode_st {
 #else
 #define FDEVENT_RDHUP  0x2000
 #endif
+/* (not POLL* values) registration flags; see fdevent_features() */
+#define FDEVENT_ET        0x10000 /* edge-triggered; see fdevent.c */
+#define FDEVENT_EXCLUSIVE 0x20000 /* wake one of procs sharing (listen) fd */
 
 #define FDEVENT_STREAM_REQUEST                  BV(0)
 #define FDEVENT_STREAM_REQUEST_BUFMIN           BV(1)
@@ -61,6 +64,18 @@ int fdevent_reset(fdevents *ev); /* "init" after fork() */
 __attribute_cold__
 void fdevent_free(fdevents *ev);
 
+__attribute_pure__
+int fdevent_features(const fdevents *ev);
+
+__attribute_pure__
+uint64_t fdevent_ctl_calls(const fdevents *ev);
+
+uint64_t fdevent_clock_usec(void);
+void fdevent_track_wake(fdevents *ev, int enable);
+
+__attribute_pure__
+uint64_t fdevent_wake_ts(const fdevents *ev);
+
 #define fdevent_fdnode_interest(fdn) (NULL != (fdn) ? (fdn)->events : 0)
 void fdevent_fdnode_event_del(fdevents *ev, fdnode *fdn);
 void fdevent_fdnode_event_set(fdevents *ev, fdnode *fdn, int events);
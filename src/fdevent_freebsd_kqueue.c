@@ -78,6 +78,7 @@ static int fdevent_freebsd_kqueue_poll(fdevents * const ev, int timeout_ms) {
     ts.tv_nsec = (timeout_ms % 1000) * 1000000;
 
     n = kevent(ev->kq_fd, NULL, 0, ev->kq_results, ev->maxfds, &ts);
+    fdevent_poll_woken(ev);
 
     for (int i = 0; i < n; ++i) {
         fdnode * const fdn = (fdnode *)ev->kq_results[i].udata;
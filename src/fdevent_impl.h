@@ -9,6 +9,11 @@
 struct epoll_event;     /* declaration */
 #endif
 
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__linux__)
+# define FDEVENT_USE_LINUX_IOURING
+struct fdevent_iouring; /* declaration */
+#endif
+
 /* MacOS 10.3.x has poll.h under /usr/include/, all other unixes
  * under /usr/include/sys/ */
 #if defined HAVE_POLL && (defined(HAVE_SYS_POLL_H) || defined(HAVE_POLL_H))
@@ -54,6 +59,7 @@ typedef enum {
     FDEVENT_HANDLER_SELECT,
     FDEVENT_HANDLER_POLL,
     FDEVENT_HANDLER_LINUX_SYSEPOLL,
+    FDEVENT_HANDLER_LINUX_IOURING,
     FDEVENT_HANDLER_SOLARIS_DEVPOLL,
     FDEVENT_HANDLER_SOLARIS_PORT,
     FDEVENT_HANDLER_FREEBSD_KQUEUE,
@@ -85,10 +91,16 @@ struct fdevents {
     log_error_st *errh;
     int *cur_fds;
     uint32_t maxfds;
+    uint64_t ctl_calls;
+    uint64_t wake_ts;       /* usec; see fdevent_track_wake() */
+    int track_wake;
   #ifdef FDEVENT_USE_LINUX_EPOLL
     int epoll_fd;
     struct epoll_event *epoll_events;
   #endif
+  #ifdef FDEVENT_USE_LINUX_IOURING
+    struct fdevent_iouring *iouring;
+  #endif
   #ifdef FDEVENT_USE_SOLARIS_DEVPOLL
     int devpoll_fd;
     struct pollfd *devpollfds;
@@ -128,6 +140,7 @@ struct fdevents {
     void (*free)(struct fdevents *ev);
     const char *event_handler;
     fdevent_handler_t type;
+    int features; /* supported registration flags, e.g. FDEVENT_ET */
 };
 
 __attribute_cold__
@@ -137,6 +150,8 @@ int fdevent_poll_init(struct fdevents *ev);
 __attribute_cold__
 int fdevent_linux_sysepoll_init(struct fdevents *ev);
 __attribute_cold__
+int fdevent_linux_iouring_init(struct fdevents *ev);
+__attribute_cold__
 int fdevent_solaris_devpoll_init(struct fdevents *ev);
 __attribute_cold__
 int fdevent_solaris_port_init(struct fdevents *ev);
@@ -145,4 +160,10 @@ int fdevent_freebsd_kqueue_init(struct fdevents *ev);
 __attribute_cold__
 int fdevent_libev_init(struct fdevents *ev);
 
+/* backend poll: mark wake from wait, prior to dispatching events */
+static inline void fdevent_poll_woken(struct fdevents *ev);
+static inline void fdevent_poll_woken(struct fdevents *ev) {
+    if (ev->track_wake) ev->wake_ts = fdevent_clock_usec();
+}
+
 #endif
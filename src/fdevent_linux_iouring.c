@@ -0,0 +1,384 @@
+#include "first.h"
+
+#include "fdevent_impl.h"
+#include "fdevent.h"
+#include "buffer.h"
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef FDEVENT_USE_LINUX_IOURING
+
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <poll.h>
+# include <linux/io_uring.h>
+# include <endian.h>
+# include <time.h>
+
+#if defined(IORING_FEAT_EXT_ARG) && defined(__NR_io_uring_setup)
+
+/* io_uring used as readiness notification mechanism (IORING_OP_POLL_ADD)
+ *
+ * Interest changes and (re)arming of polls are queued as SQEs and are
+ * submitted in a single io_uring_enter() together with the wait for
+ * completions, instead of an epoll_ctl() syscall per interest change.
+ *
+ * Polls are one-shot and are re-armed after the fd handler runs (unless
+ * the handler changed the interest), so the semantics are level-triggered,
+ * same as other fdevent backends.  A generation number per fd is embedded
+ * in user_data so that completions from stale (removed) polls are ignored.
+ *
+ * If no SQE is available to (re)arm a poll (SQ full and CQ backlogged),
+ * the fd is queued and re-armed once completions have been consumed.
+ */
+
+#define FDEVENT_IOURING_REMOVE_UDATA (~(uint64_t)0)
+
+typedef struct {
+    uint32_t gen;
+    uint16_t armed;
+    uint16_t pending; /* in rearm list */
+} fdevent_iouring_fd;
+
+struct fdevent_iouring {
+    int fd;
+    uint32_t to_submit;
+
+    /* submission queue */
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    struct io_uring_sqe *sqes;
+
+    /* completion queue */
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_sz;
+    size_t cq_ring_sz;
+    size_t sqes_sz;
+    uint32_t sq_entries;
+
+    fdevent_iouring_fd *fds;
+    int *rearm;          /* fds waiting for SQE to re-arm poll */
+    uint32_t rearm_used;
+};
+
+static int fdevent_iouring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, const void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, arg, argsz);
+}
+
+__attribute_cold__
+__attribute_noinline__
+static int fdevent_linux_iouring_flush(struct fdevent_iouring * const iour) {
+    /* submission queue is full; submit without waiting */
+    while (iour->to_submit) {
+        int rc = fdevent_iouring_enter(iour->fd, iour->to_submit, 0, 0, NULL, 0);
+        if (rc > 0)
+            iour->to_submit -= (uint32_t)rc;
+        else if (rc < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            return -1;
+        else
+            break; /* CQ backlog; process completions before submitting */
+    }
+    return 0;
+}
+
+static struct io_uring_sqe * fdevent_linux_iouring_get_sqe(struct fdevent_iouring * const iour) {
+    uint32_t tail = *iour->sq_tail;
+    if (tail - __atomic_load_n(iour->sq_head, __ATOMIC_ACQUIRE)
+        >= iour->sq_entries) {
+        if (0 != fdevent_linux_iouring_flush(iour)) return NULL;
+        if (tail - __atomic_load_n(iour->sq_head, __ATOMIC_ACQUIRE)
+            >= iour->sq_entries) {
+            errno = EAGAIN;
+            return NULL;
+        }
+    }
+    const uint32_t idx = tail & *iour->sq_mask;
+    struct io_uring_sqe * const sqe = iour->sqes + idx;
+    memset(sqe, 0, sizeof(*sqe));
+    iour->sq_array[idx] = idx;
+    __atomic_store_n(iour->sq_tail, tail+1, __ATOMIC_RELEASE);
+    ++iour->to_submit;
+    return sqe;
+}
+
+static int fdevent_linux_iouring_poll_add(struct fdevent_iouring * const iour, int fd, int events) {
+    struct io_uring_sqe * const sqe = fdevent_linux_iouring_get_sqe(iour);
+    if (NULL == sqe) return -1;
+    uint32_t mask = (uint32_t)(events | FDEVENT_ERR | FDEVENT_HUP);
+  #if __BYTE_ORDER == __BIG_ENDIAN
+    mask = (mask << 16) | (mask >> 16);
+  #endif
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = mask;
+    sqe->user_data = ((uint64_t)iour->fds[fd].gen << 32) | (uint32_t)fd;
+    iour->fds[fd].armed = 1;
+    return 0;
+}
+
+static int fdevent_linux_iouring_poll_remove(struct fdevent_iouring * const iour, int fd) {
+    if (!iour->fds[fd].armed) return 0;
+    struct io_uring_sqe * const sqe = fdevent_linux_iouring_get_sqe(iour);
+    if (NULL == sqe) return -1;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = ((uint64_t)iour->fds[fd].gen << 32) | (uint32_t)fd;
+    sqe->user_data = FDEVENT_IOURING_REMOVE_UDATA;
+    iour->fds[fd].armed = 0;
+    return 0;
+}
+
+__attribute_cold__
+static void fdevent_linux_iouring_free(fdevents *ev) {
+    struct fdevent_iouring * const iour = ev->iouring;
+    if (NULL == iour) return;
+    if (iour->sqes)
+        munmap(iour->sqes, iour->sqes_sz);
+    if (iour->cq_ring && iour->cq_ring != iour->sq_ring)
+        munmap(iour->cq_ring, iour->cq_ring_sz);
+    if (iour->sq_ring)
+        munmap(iour->sq_ring, iour->sq_ring_sz);
+    if (iour->fd >= 0)
+        close(iour->fd);
+    free(iour->fds);
+    free(iour->rearm);
+    free(iour);
+    ev->iouring = NULL;
+}
+
+static void fdevent_linux_iouring_rearm(struct fdevent_iouring * const iour, const int fd, const int events) {
+    if (0 == fdevent_linux_iouring_poll_add(iour, fd, events)) return;
+    /* no SQE available; retry in fdevent_linux_iouring_rearm_pending() */
+    if (!iour->fds[fd].pending) {
+        iour->fds[fd].pending = 1;
+        iour->rearm[iour->rearm_used++] = fd;
+    }
+}
+
+static void fdevent_linux_iouring_rearm_pending(fdevents * const ev) {
+    struct fdevent_iouring * const iour = ev->iouring;
+    uint32_t j = 0;
+    for (uint32_t i = 0; i < iour->rearm_used; ++i) {
+        const int fd = iour->rearm[i];
+        /* skip if fd no longer registered, interest removed, or
+         * poll armed since (e.g. by fdevent_linux_iouring_event_set()) */
+        const fdnode * const fdn = ev->fdarray[fd];
+        if (NULL != fdn && !((uintptr_t)fdn & 0x3) && fdn->events
+            && !iour->fds[fd].armed
+            && 0 != fdevent_linux_iouring_poll_add(iour, fd, fdn->events)) {
+            iour->rearm[j++] = fd; /* still no SQE available */
+            continue;
+        }
+        iour->fds[fd].pending = 0;
+    }
+    iour->rearm_used = j;
+}
+
+static int fdevent_linux_iouring_event_del(fdevents *ev, fdnode *fdn) {
+    struct fdevent_iouring * const iour = ev->iouring;
+    const int fd = fdn->fd;
+    if (0 != fdevent_linux_iouring_poll_remove(iour, fd)) return -1;
+    ++iour->fds[fd].gen;
+    return 0;
+}
+
+static int fdevent_linux_iouring_event_set(fdevents *ev, fdnode *fdn, int events) {
+    struct fdevent_iouring * const iour = ev->iouring;
+    const int fd = fdn->fde_ndx = fdn->fd;
+    if (0 != fdevent_linux_iouring_poll_remove(iour, fd)) return -1;
+    ++iour->fds[fd].gen;
+    fdevent_linux_iouring_rearm(iour, fd, events);
+    return 0;
+}
+
+static int fdevent_linux_iouring_poll(fdevents * const ev, int timeout_ms) {
+    struct fdevent_iouring * const iour = ev->iouring;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (iour->rearm_used) {
+        fdevent_linux_iouring_rearm_pending(ev);
+        if (iour->rearm_used) timeout_ms = 0; /*(do not wait on unarmed fds)*/
+    }
+    if (timeout_ms >= 0) {
+        ts.tv_sec  = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    uint32_t head = *iour->cq_head;
+    if (head == __atomic_load_n(iour->cq_tail, __ATOMIC_ACQUIRE)) {
+        /* submit queued SQEs and wait for completions in a single syscall */
+        int rc = fdevent_iouring_enter(iour->fd, iour->to_submit, 1,
+                                       IORING_ENTER_GETEVENTS
+                                      |IORING_ENTER_EXT_ARG,
+                                       &arg, sizeof(arg));
+        if (rc >= 0)
+            iour->to_submit -= (uint32_t)rc;
+        else if (errno != ETIME && errno != EINTR && errno != EBUSY)
+            return -1;
+    }
+
+    fdevent_poll_woken(ev);
+
+    int n = 0;
+    const uint32_t tail = __atomic_load_n(iour->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        const struct io_uring_cqe * const cqe =
+          iour->cqes + (head & *iour->cq_mask);
+        const uint64_t udata = cqe->user_data;
+        const int res = cqe->res;
+        /* consume CQE before running handler, so that the kernel can post
+         * completions for SQEs submitted while SQ is full (re-arm below) */
+        __atomic_store_n(iour->cq_head, ++head, __ATOMIC_RELEASE);
+        if (FDEVENT_IOURING_REMOVE_UDATA == udata) continue;
+        const int fd = (int)(uint32_t)udata;
+        const uint32_t gen = (uint32_t)(udata >> 32);
+        if (gen != iour->fds[fd].gen) continue; /*(stale completion)*/
+        iour->fds[fd].armed = 0;
+        fdnode * const fdn = ev->fdarray[fd];
+        if (NULL == fdn || ((uintptr_t)fdn & 0x3)) continue;
+        if ((fdevent_handler)NULL != fdn->handler) {
+            ++n;
+            (*fdn->handler)(fdn->ctx, res > 0 ? res : FDEVENT_ERR);
+        }
+        /* re-arm poll if interest did not change while handling event
+         * (fdn might have been unregistered and fd reused by handler) */
+        if (res > 0 && gen == iour->fds[fd].gen && !iour->fds[fd].armed
+            && fdn == ev->fdarray[fd] && fdn->events)
+            fdevent_linux_iouring_rearm(iour, fd, fdn->events);
+    }
+    if (iour->rearm_used) fdevent_linux_iouring_rearm_pending(ev);
+    return n;
+}
+
+__attribute_cold__
+static int fdevent_linux_iouring_setup(struct fdevent_iouring *iour, uint32_t maxfds);
+
+__attribute_cold__
+int fdevent_linux_iouring_init(fdevents *ev) {
+    force_assert(POLLIN    == FDEVENT_IN);
+    force_assert(POLLPRI   == FDEVENT_PRI);
+    force_assert(POLLOUT   == FDEVENT_OUT);
+    force_assert(POLLERR   == FDEVENT_ERR);
+    force_assert(POLLHUP   == FDEVENT_HUP);
+    force_assert(POLLNVAL  == FDEVENT_NVAL);
+  #ifdef POLLRDHUP
+    force_assert(POLLRDHUP == FDEVENT_RDHUP);
+  #endif
+
+    ev->type      = FDEVENT_HANDLER_LINUX_IOURING;
+    ev->event_set = fdevent_linux_iouring_event_set;
+    ev->event_del = fdevent_linux_iouring_event_del;
+    ev->poll      = fdevent_linux_iouring_poll;
+    ev->free      = fdevent_linux_iouring_free;
+
+    struct fdevent_iouring * const iour = ev->iouring =
+      calloc(1, sizeof(struct fdevent_iouring));
+    force_assert(NULL != iour);
+    iour->fd = -1;
+    iour->fds = calloc(ev->maxfds, sizeof(*iour->fds));
+    force_assert(NULL != iour->fds);
+    iour->rearm = malloc(ev->maxfds * sizeof(*iour->rearm));
+    force_assert(NULL != iour->rearm);
+
+    if (0 == fdevent_linux_iouring_setup(iour, ev->maxfds)) return 0;
+
+    fdevent_linux_iouring_free(ev);
+    return -1;
+}
+
+__attribute_cold__
+static int fdevent_linux_iouring_setup(struct fdevent_iouring * const iour, const uint32_t maxfds) {
+    /* one outstanding poll per fd; size CQ to hold completion for each */
+    uint32_t entries = 256;
+    uint32_t cq_entries = 2;
+    while (cq_entries < 2*maxfds && cq_entries < 65536) cq_entries <<= 1;
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = cq_entries;
+    iour->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (iour->fd < 0) return -1;
+    fdevent_setfd_cloexec(iour->fd);
+
+    if (!(params.features & IORING_FEAT_EXT_ARG)
+        || !(params.features & IORING_FEAT_NODROP)) {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    iour->sq_entries = params.sq_entries;
+    iour->sq_ring_sz = params.sq_off.array + params.sq_entries*sizeof(uint32_t);
+    iour->cq_ring_sz = params.cq_off.cqes
+                     + params.cq_entries*sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (iour->cq_ring_sz > iour->sq_ring_sz)
+            iour->sq_ring_sz = iour->cq_ring_sz;
+        iour->cq_ring_sz = iour->sq_ring_sz;
+    }
+
+    iour->sq_ring = mmap(NULL, iour->sq_ring_sz, PROT_READ|PROT_WRITE,
+                         MAP_SHARED|MAP_POPULATE, iour->fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == iour->sq_ring) {
+        iour->sq_ring = NULL;
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        iour->cq_ring = iour->sq_ring;
+    else {
+        iour->cq_ring = mmap(NULL, iour->cq_ring_sz, PROT_READ|PROT_WRITE,
+                             MAP_SHARED|MAP_POPULATE, iour->fd,
+                             IORING_OFF_CQ_RING);
+        if (MAP_FAILED == iour->cq_ring) {
+            iour->cq_ring = NULL;
+            return -1;
+        }
+    }
+    iour->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+    iour->sqes = mmap(NULL, iour->sqes_sz, PROT_READ|PROT_WRITE,
+                      MAP_SHARED|MAP_POPULATE, iour->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == iour->sqes) {
+        iour->sqes = NULL;
+        return -1;
+    }
+
+    char * const sq = iour->sq_ring;
+    iour->sq_head  = (uint32_t *)(sq + params.sq_off.head);
+    iour->sq_tail  = (uint32_t *)(sq + params.sq_off.tail);
+    iour->sq_mask  = (uint32_t *)(sq + params.sq_off.ring_mask);
+    iour->sq_array = (uint32_t *)(sq + params.sq_off.array);
+    char * const cq = iour->cq_ring;
+    iour->cq_head  = (uint32_t *)(cq + params.cq_off.head);
+    iour->cq_tail  = (uint32_t *)(cq + params.cq_off.tail);
+    iour->cq_mask  = (uint32_t *)(cq + params.cq_off.ring_mask);
+    iour->cqes     = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+#else /* kernel headers lack required io_uring features */
+
+__attribute_cold__
+int fdevent_linux_iouring_init(fdevents *ev) {
+    UNUSED(ev);
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
+
+#endif
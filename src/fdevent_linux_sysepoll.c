@@ -26,6 +26,20 @@ static int fdevent_linux_sysepoll_event_set(fdevents *ev, fdnode *fdn, int event
     int op = (-1 == fdn->fde_ndx) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
     int fd = fdn->fde_ndx = fdn->fd;
     struct epoll_event ep;
+    if (events & FDEVENT_ET) /*(register once for all events)*/
+        events = EPOLLIN | EPOLLOUT | FDEVENT_RDHUP | EPOLLET;
+  #ifdef EPOLLEXCLUSIVE
+    /* EPOLLEXCLUSIVE may be set only with EPOLL_CTL_ADD (not EPOLL_CTL_MOD) */
+    if ((events | fdn->events) & FDEVENT_EXCLUSIVE) {
+        if (op == EPOLL_CTL_MOD) {
+            if (0 != epoll_ctl(ev->epoll_fd, EPOLL_CTL_DEL, fd, NULL))
+                return -1;
+            op = EPOLL_CTL_ADD;
+        }
+        if (events & FDEVENT_EXCLUSIVE)
+            events = (events & ~FDEVENT_EXCLUSIVE) | EPOLLEXCLUSIVE;
+    }
+  #endif
   #ifndef EPOLLRDHUP
     events &= ~FDEVENT_RDHUP;
   #endif
@@ -36,9 +50,12 @@ static int fdevent_linux_sysepoll_event_set(fdevents *ev, fdnode *fdn, int event
 
 static int fdevent_linux_sysepoll_poll(fdevents * const ev, int timeout_ms) {
     int n = epoll_wait(ev->epoll_fd, ev->epoll_events, ev->maxfds, timeout_ms);
+    fdevent_poll_woken(ev);
     for (int i = 0; i < n; ++i) {
         fdnode * const fdn = (fdnode *)ev->epoll_events[i].data.ptr;
         int revents = ev->epoll_events[i].events;
+        if (fdn->events & FDEVENT_ET) /*(RDHUP only if of interest)*/
+            revents &= (fdn->events | ~FDEVENT_RDHUP);
         if ((fdevent_handler)NULL != fdn->handler) {
             (*fdn->handler)(fdn->ctx, revents);
         }
@@ -62,6 +79,10 @@ int fdevent_linux_sysepoll_init(fdevents *ev) {
 	ev->event_del = fdevent_linux_sysepoll_event_del;
 	ev->poll      = fdevent_linux_sysepoll_poll;
 	ev->free      = fdevent_linux_sysepoll_free;
+	ev->features  = FDEVENT_ET;
+      #ifdef EPOLLEXCLUSIVE
+	ev->features |= FDEVENT_EXCLUSIVE;
+      #endif
 
 	if (-1 == (ev->epoll_fd = epoll_create(ev->maxfds))) return -1;
 
@@ -86,6 +86,7 @@ static int fdevent_poll_next_ndx(const fdevents *ev, int ndx) {
 
 static int fdevent_poll_poll(fdevents *ev, int timeout_ms) {
     const int n = poll(ev->pollfds, ev->used, timeout_ms);
+    fdevent_poll_woken(ev);
     for (int ndx=-1,i=0; i<n && -1!=(ndx=fdevent_poll_next_ndx(ev,ndx)); ++i){
         fdnode *fdn = ev->fdarray[ev->pollfds[ndx].fd];
         int revents = ev->pollfds[ndx].revents;
@@ -83,6 +83,7 @@ static int fdevent_select_poll(fdevents *ev, int timeout_ms) {
     ev->select_error = ev->select_set_error;
 
     n = select(ev->select_max_fd + 1, &(ev->select_read), &(ev->select_write), &(ev->select_error), &tv);
+    fdevent_poll_woken(ev);
     for (int ndx = -1, i = 0; i < n; ++i) {
         fdnode *fdn;
         ndx = fdevent_select_event_next_fdndx(ev, ndx);
@@ -50,6 +50,7 @@ static int fdevent_solaris_devpoll_poll(fdevents *ev, int timeout_ms) {
     dopoll.dp_fds = ev->devpollfds;
 
     n = ioctl(ev->devpoll_fd, DP_POLL, &dopoll);
+    fdevent_poll_woken(ev);
 
     for (int i = 0; i < n; ++i) {
         fdnode * const fdn = ev->fdarray[ev->devpollfds[i].fd];
@@ -56,6 +56,7 @@ static int fdevent_solaris_port_poll(fdevents *ev, int timeout_ms) {
 		/* for other errors we didn't get any events either */
 		if (!(errno == ETIME && wait_for_events != available_events)) return ret;
 	}
+	fdevent_poll_woken(ev);
 
     for (int i = 0; i < (int)available_events; ++i) {
         int fd = (int)ev->port_events[i].portev_object;
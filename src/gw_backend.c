@@ -41,6 +41,11 @@
 
 #include "status_counter.h"
 
+/* splice() relay through kernel pipe for plaintext transparent mode */
+#if defined(__linux__) && defined(HAVE_PIPE2) && defined(SPLICE_F_NONBLOCK)
+#define GW_BACKEND_SPLICE
+#endif
+
 __attribute_noinline__
 static int * gw_status_get_counter(gw_host *host, gw_proc *proc, const char *tag, size_t tlen) {
     /*(At the cost of some memory, could prepare strings for host and for proc
@@ -1070,6 +1075,8 @@ static void gw_restart_dead_procs(gw_host * const host, log_error_st * const err
 
 #include "base.h"
 #include "connections.h"
+#include "http_chunk.h"
+#include "reqpool.h"
 #include "response.h"
 
 
@@ -1077,9 +1084,10 @@ static void gw_restart_dead_procs(gw_host * const host, log_error_st * const err
 static handler_t gw_handle_fdevent(void *ctx, int revents);
 
 
-static gw_handler_ctx * handler_ctx_init(size_t sz) {
-    gw_handler_ctx *hctx = calloc(1, 0 == sz ? sizeof(*hctx) : sz);
-    force_assert(hctx);
+static gw_handler_ctx * handler_ctx_init(request_st * const r, size_t sz) {
+    /*(request-lifetime; released with r->arena in request_reset())*/
+    gw_handler_ctx *hctx =
+      request_arena_calloc(r, 0 == sz ? sizeof(*hctx) : sz);
 
     /*hctx->response = chunk_buffer_acquire();*//*(allocated when needed)*/
 
@@ -1089,6 +1097,8 @@ static gw_handler_ctx * handler_ctx_init(size_t sz) {
     hctx->proc = NULL;
 
     hctx->fd = -1;
+    hctx->pipefds[0] = -1;
+    hctx->pipefds[1] = -1;
 
     hctx->reconnects = 0;
     hctx->send_content_body = 1;
@@ -1108,7 +1118,7 @@ static void handler_ctx_free(gw_handler_ctx *hctx) {
     if (hctx->rb) chunkqueue_free(hctx->rb);
     chunkqueue_reset(&hctx->wb);
 
-    free(hctx);
+    /*(hctx memory is in r->arena)*/
 }
 
 static void handler_ctx_clear(gw_handler_ctx *hctx) {
@@ -1757,7 +1767,227 @@ void gw_set_transparent(gw_handler_ctx *hctx) {
 }
 
 
+#ifdef GW_BACKEND_SPLICE
+
+/* Transparent mode (mod_sockproxy, CONNECT and Upgrade in mod_proxy) relays
+ * bytes unmodified between client and backend.  For plaintext HTTP/1.x client
+ * connections, move the bytes socket-to-socket through a kernel pipe with
+ * splice() instead of read() into and write() out of chunkqueues.
+ * Bytes left in the pipe when the destination would block are drained into
+ * the chunkqueue for the destination, which is then handled as usual, so the
+ * pipe is always empty between calls and ordering of data is preserved. */
+
+static int gw_splice_pipe(gw_handler_ctx * const hctx, request_st * const r) {
+    if (hctx->pipefds[0] >= 0) return 1;
+    if (hctx->pipefds[0] < -1) return 0; /*(splice() unavailable)*/
+    if (0 != pipe2(hctx->pipefds, O_NONBLOCK | O_CLOEXEC)) {
+        hctx->pipefds[0] = -1;
+        hctx->pipefds[1] = -1;
+        return 0; /*(e.g. EMFILE; try again next time)*/
+    }
+    r->con->srv->cur_fds += 2;
+    return 1;
+}
+
+static void gw_splice_close(gw_handler_ctx * const hctx, request_st * const r) {
+    if (hctx->pipefds[0] >= 0) {
+        close(hctx->pipefds[0]);
+        close(hctx->pipefds[1]);
+        r->con->srv->cur_fds -= 2;
+    }
+    hctx->pipefds[0] = -1;
+    hctx->pipefds[1] = -1;
+}
+
+__attribute_cold__
+static void gw_splice_disable(gw_handler_ctx * const hctx, request_st * const r) {
+    gw_splice_close(hctx, r);
+    hctx->pipefds[0] = -2; /*(do not retry splice() on this hctx)*/
+}
+
+__attribute_cold__
+static int gw_splice_drain(gw_handler_ctx * const hctx, chunkqueue * const cq, size_t len) {
+    /* move bytes stranded in pipe into cq (destination would block) */
+    buffer * const b = chunkqueue_append_buffer_open_sz(cq, len+1);
+    do {
+        ssize_t rd = read(hctx->pipefds[0], b->ptr+buffer_string_length(b), len);
+        if (rd <= 0) {
+            if (rd < 0 && errno == EINTR) continue;
+            break; /*(should not happen; data is known to be in pipe)*/
+        }
+        buffer_commit(b, (size_t)rd);
+        len -= (size_t)rd;
+    } while (len);
+    chunkqueue_append_buffer_commit(cq);
+    return (0 == len);
+}
+
+static int gw_splice_response_ready(const gw_handler_ctx * const hctx, const request_st * const r) {
+    const connection * const con = r->con;
+    return (-1 == hctx->wb_reqlen    /*(gw_set_transparent())*/
+            && NULL == hctx->opts.parse
+            && hctx->pipefds[0] != -2
+            && r->state == CON_STATE_WRITE
+            && r->http_version <= HTTP_VERSION_1_1
+            && !con->is_ssl_sock
+            && con->is_writable > 0
+            && !con->traffic_limit_reached
+            && 0 == r->conf.bytes_per_second
+            && 0 == r->conf.global_bytes_per_second
+            && 0 == con->srv->bytes_per_second_cnt[1]
+            && !r->resp_send_chunked
+            && NULL == r->gw_dechunk
+            && con->write_queue == &r->write_queue
+            && chunkqueue_is_empty(&r->write_queue));
+}
+
+static handler_t gw_splice_response(gw_handler_ctx * const hctx, request_st * const r) {
+    if (!gw_splice_pipe(hctx, r)) return HANDLER_UNSET;
+    connection * const con = r->con;
+    chunkqueue * const cq = &r->write_queue;
+    off_t total = 0;
+    do {
+        ssize_t n = splice(hctx->fd, NULL, hctx->pipefds[1], NULL, 65536,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n <= 0) {
+            if (0 == n) return HANDLER_FINISHED; /* read finished */
+            switch (errno) {
+              case EAGAIN:
+             #ifdef EWOULDBLOCK
+             #if EWOULDBLOCK != EAGAIN
+              case EWOULDBLOCK:
+             #endif
+             #endif
+              case EINTR:
+                return HANDLER_GO_ON;
+              case EINVAL:
+              case ENOSYS:
+                if (0 == total) {
+                    gw_splice_disable(hctx, r);
+                    return HANDLER_UNSET;
+                }
+                return HANDLER_GO_ON;
+              default:
+                log_perror(r->conf.errh, __FILE__, __LINE__,
+                  "splice() %d %d", con->fd, hctx->fd);
+                return HANDLER_ERROR;
+            }
+        }
+
+        ssize_t wr = splice(hctx->pipefds[0], NULL, con->fd, NULL, (size_t)n,
+                            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        int err = 0;
+        if (wr < 0) {
+            /* on error other than EAGAIN, stop splicing and leave it to
+             * connection write of r->write_queue to report error */
+            err = (errno != EAGAIN && errno != EINTR);
+            wr = 0;
+        }
+
+        if (wr) {
+            cq->bytes_in  += wr;
+            cq->bytes_out += wr;
+            con->bytes_written += wr;
+            con->bytes_written_cur_second += wr;
+            con->write_request_ts = log_epoch_secs;
+        }
+
+        if (wr < n) {
+            if (!gw_splice_drain(hctx, cq, (size_t)(n - wr)))
+                return HANDLER_ERROR;
+            if (err)
+                gw_splice_disable(hctx, r);
+            else
+                con->is_writable = 0;
+            break;
+        }
+
+        total += n;
+    } while (total < MAX_WRITE_LIMIT);
+
+    return HANDLER_GO_ON;
+}
+
+static int gw_splice_request(gw_handler_ctx * const hctx, request_st * const r) {
+    connection * const con = r->con;
+    if (!(-1 == hctx->wb_reqlen    /*(gw_set_transparent())*/
+          && NULL == hctx->stdin_append
+          && hctx->state == GW_STATE_WRITE
+          && hctx->pipefds[0] != -2
+          && r->http_version <= HTTP_VERSION_1_1
+          && -2 == r->reqbody_length
+          && !con->is_ssl_sock
+          && con->is_readable > 0
+          && !(r->conf.stream_request_body
+               & FDEVENT_STREAM_REQUEST_BACKEND_SHUT_WR)
+          && chunkqueue_is_empty(&r->read_queue)
+          && chunkqueue_is_empty(&r->reqbody_queue)
+          && chunkqueue_is_empty(&hctx->wb)))
+        return 0;
+
+    /* r->conf.max_request_size is in kBytes; leave enforcement to
+     * con->reqbody_read() when near limit */
+    const off_t max_request_size = (off_t)r->conf.max_request_size << 10;
+    if (0 != max_request_size
+        && r->reqbody_queue.bytes_in + MAX_READ_LIMIT > max_request_size)
+        return 0;
+
+    if (!gw_splice_pipe(hctx, r)) return 0;
+
+    off_t total = 0;
+    do {
+        ssize_t n = splice(con->fd, NULL, hctx->pipefds[1], NULL, 65536,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n <= 0) {
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+                if (errno == EAGAIN) con->is_readable = 0;
+                break;
+            }
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS) && 0 == total)
+                gw_splice_disable(hctx, r);
+            /* EOF or error; let con->reqbody_read() detect and handle it */
+            if (0 == total) return 0;
+            break;
+        }
+
+        ssize_t wr = splice(hctx->pipefds[0], NULL, hctx->fd, NULL, (size_t)n,
+                            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        int err = 0;
+        if (wr < 0) {
+            /* on error other than EAGAIN, stop splicing and leave it to
+             * gw_write_request() of hctx->wb to report error */
+            err = (errno != EAGAIN && errno != EINTR);
+            wr = 0;
+        }
+
+        con->bytes_read += n;
+        r->reqbody_queue.bytes_in  += n;
+        r->reqbody_queue.bytes_out += n;
+        hctx->wb.bytes_in  += wr;
+        hctx->wb.bytes_out += wr;
+
+        if (wr < n) {
+            if (!gw_splice_drain(hctx, &hctx->wb, (size_t)(n - wr)))
+                return 0;
+            if (err) gw_splice_disable(hctx, r);
+            break;
+        }
+
+        total += n;
+    } while (total < MAX_READ_LIMIT);
+
+    con->read_idle_ts = log_epoch_secs;
+    hctx->proc->last_used = log_epoch_secs;
+    return 1;
+}
+
+#endif /* GW_BACKEND_SPLICE */
+
+
 static void gw_backend_close(gw_handler_ctx * const hctx, request_st * const r) {
+  #ifdef GW_BACKEND_SPLICE
+    gw_splice_close(hctx, r);
+  #endif
     if (hctx->fd >= 0) {
         fdevent_fdnode_event_del(hctx->ev, hctx->fdn);
         /*fdevent_unregister(ev, hctx->fd);*//*(handled below)*/
@@ -2048,11 +2278,21 @@ handler_t gw_handle_subrequest(request_st * const r, void *p_d) {
     gw_handler_ctx *hctx = r->plugin_ctx[p->id];
     if (NULL == hctx) return HANDLER_GO_ON;
 
-    if ((r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE_BUFMIN)
+    if ((r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE)
         && r->resp_body_started) {
-        if (chunkqueue_length(&r->write_queue) > 65536 - 4096) {
+        /* pause reading from backend while too much data is pending to be
+         * written to client (FDEVENT_STREAM_RESPONSE_BUFMIN) or while
+         * memory caps are exceeded (server.max-*-mem) */
+        if ((r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE_BUFMIN)
+            && chunkqueue_length(&r->write_queue) > 65536 - 4096) {
             fdevent_fdnode_event_clr(hctx->ev, hctx->fdn, FDEVENT_IN);
         }
+        else if (http_chunk_mem_pause(r)) {
+            if (fdevent_fdnode_interest(hctx->fdn) & FDEVENT_IN) {
+                fdevent_fdnode_event_clr(hctx->ev, hctx->fdn, FDEVENT_IN);
+                status_counter_inc(CONST_STR_LEN("chunkqueue.mem-pauses"));
+            }
+        }
         else if (!(fdevent_fdnode_interest(hctx->fdn) & FDEVENT_IN)) {
             /* optimistic read from backend */
             handler_t rc;
@@ -2081,7 +2321,13 @@ handler_t gw_handle_subrequest(request_st * const r, void *p_d) {
             if (0 != hctx->wb.bytes_in) return HANDLER_WAIT_FOR_EVENT;
         }
         else {
+          #ifdef GW_BACKEND_SPLICE
+            handler_t rc = gw_splice_request(hctx, r)
+              ? HANDLER_GO_ON
+              : r->con->reqbody_read(r);
+          #else
             handler_t rc = r->con->reqbody_read(r);
+          #endif
 
             /* XXX: create configurable flag */
             /* CGI environment requires that Content-Length be set.
@@ -2140,15 +2386,24 @@ static handler_t gw_recv_response_error(gw_handler_ctx * const hctx, request_st
 
 
 static handler_t gw_recv_response(gw_handler_ctx * const hctx, request_st * const r) {
-    /*(XXX: make this a configurable flag for other protocols)*/
-    buffer *b = hctx->opts.backend == BACKEND_FASTCGI
-      ? chunk_buffer_acquire()
-      : hctx->response;
     const off_t bytes_in = r->write_queue.bytes_in;
+    handler_t rc = HANDLER_UNSET;
 
-    handler_t rc = http_response_read(r, &hctx->opts, b, hctx->fdn);
+  #ifdef GW_BACKEND_SPLICE
+    if (gw_splice_response_ready(hctx, r))
+        rc = gw_splice_response(hctx, r); /*(HANDLER_UNSET if unavailable)*/
+    if (HANDLER_UNSET == rc)
+  #endif
+    {
+        /*(XXX: make this a configurable flag for other protocols)*/
+        buffer *b = hctx->opts.backend == BACKEND_FASTCGI
+          ? chunk_buffer_acquire()
+          : hctx->response;
 
-    if (b != hctx->response) chunk_buffer_release(b);
+        rc = http_response_read(r, &hctx->opts, b, hctx->fdn);
+
+        if (b != hctx->response) chunk_buffer_release(b);
+    }
 
     gw_proc * const proc = hctx->proc;
 
@@ -2522,7 +2777,7 @@ handler_t gw_check_extension(request_st * const r, gw_plugin_data * const p, int
         }
     }
 
-    if (!hctx) hctx = handler_ctx_init(hctx_sz);
+    if (!hctx) hctx = handler_ctx_init(r, hctx_sz);
 
     hctx->ev               = r->con->srv->ev;
     hctx->r                = r;
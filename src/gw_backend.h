@@ -310,6 +310,7 @@ typedef struct gw_handler_ctx {
     struct fdevents *ev;
     fdnode   *fdn;       /* fdevent (fdnode *) object */
     int       fd;        /* fd to the gw process */
+    int       pipefds[2]; /* splice() relay pipe (transparent mode) */
 
     pid_t     pid;
     int       reconnects; /* number of reconnect attempts */
@@ -2478,6 +2478,8 @@ h2_retire_con (request_st * const h2r, connection * const con)
             con->bytes_written_cur_second += written;
             if (h2r->conf.global_bytes_per_second_cnt_ptr)
                 *(h2r->conf.global_bytes_per_second_cnt_ptr) += written;
+            if (con->srv->bytes_per_second_cnt[1])
+                con->srv->bytes_per_second_cnt[0] += written;
         }
     }
     else { /* CON_STATE_ERROR */
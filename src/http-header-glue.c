@@ -9,6 +9,7 @@
 #include "etag.h"
 #include "http_chunk.h"
 #include "http_header.h"
+#include "reqpool.h"
 #include "response.h"
 #include "sock_addr.h"
 #include "stat_cache.h"
@@ -261,8 +262,7 @@ void http_response_body_clear (request_st * const r, int preserve_length) {
         /*(if not preserving Content-Length, do not preserve trailers, if any)*/
         r->resp_decode_chunked = 0;
         if (r->gw_dechunk) {
-            free(r->gw_dechunk->b.ptr);
-            free(r->gw_dechunk);
+            free(r->gw_dechunk->b.ptr); /*(r->gw_dechunk in r->arena)*/
             r->gw_dechunk = NULL;
         }
     }
@@ -284,8 +284,7 @@ static void http_response_header_clear (request_st * const r) {
     r->resp_send_chunked = 0;
     r->resp_decode_chunked = 0;
     if (r->gw_dechunk) {
-        free(r->gw_dechunk->b.ptr);
-        free(r->gw_dechunk);
+        free(r->gw_dechunk->b.ptr); /*(r->gw_dechunk in r->arena)*/
         r->gw_dechunk = NULL;
     }
 }
@@ -1185,10 +1184,9 @@ static int http_response_process_headers(request_st * const r, http_response_opt
           case HTTP_HEADER_TRANSFER_ENCODING:
             /*(assumes "Transfer-Encoding: chunked"; does not verify)*/
             r->resp_decode_chunked = 1;
-            r->gw_dechunk = calloc(1, sizeof(response_dechunk));
+            r->gw_dechunk = request_arena_calloc(r, sizeof(response_dechunk));
             /* XXX: future: might consider using chunk_buffer_acquire()
              *      and chunk_buffer_release() for r->gw_dechunk->b */
-            force_assert(r->gw_dechunk);
             continue;
           case HTTP_HEADER_HTTP2_SETTINGS:
             /* RFC7540 3.2.1
@@ -1554,6 +1552,14 @@ handler_t http_response_read(request_st * const r, http_response_opts * const op
             }
         }
 
+        if (http_chunk_mem_pause(r)) {
+            /* memory caps exceeded; pause reading from backend until
+             * response data is sent to client (see gw_handle_subrequest()) */
+            if (!r->con->is_writable)
+                fdevent_fdnode_event_clr(r->con->srv->ev, fdn, FDEVENT_IN);
+            break;
+        }
+
         if ((size_t)n < avail)
             break; /* emptied kernel read buffer or partial read */
     }
@@ -10,6 +10,8 @@
 #include "http_chunk.h"
 #include "base.h"
 #include "chunk.h"
+#include "h2.h"
+#include "status_counter.h"
 #include "stat_cache.h"
 #include "fdevent.h"
 #include "log.h"
@@ -218,6 +220,51 @@ static int http_chunk_append_cq_to_tempfile(request_st * const r, chunkqueue * c
 }
 
 __attribute_pure__
+static off_t http_chunk_connection_mem(const connection * const con) {
+    /*(HTTP/1.1: con->write_queue is &con->request.write_queue)*/
+    off_t len = chunkqueue_length_mem(con->write_queue);
+    const h2con * const h2c = con->h2;
+    if (h2c) {
+        for (uint32_t i = 0; i < h2c->rused; ++i)
+            len += chunkqueue_length_mem(&h2c->r[i]->write_queue);
+    }
+    return len;
+}
+
+__attribute_pure__
+static int http_chunk_mem_exceeded(const request_st * const r, const size_t len) {
+    const server * const srv = r->con->srv;
+    if (srv->srvconf.max_mem
+        && chunkqueue_mem_total() + (off_t)len > srv->srvconf.max_mem)
+        return 1;
+    if (srv->srvconf.max_connection_mem
+        && http_chunk_connection_mem(r->con) + (off_t)len
+             > (off_t)srv->srvconf.max_connection_mem)
+        return 1;
+    if (srv->srvconf.max_request_mem
+        && chunkqueue_length_mem(&r->write_queue) + (off_t)len
+             > (off_t)srv->srvconf.max_request_mem)
+        return 1;
+    return 0;
+}
+
+__attribute_pure__
+static int http_chunk_mem_pausable(const request_st * const r) {
+    /* streamed response, and not draining backend after backend closed
+     * (FDEVENT_STREAM_RESPONSE_POLLRDHUP) */
+    return (r->conf.stream_response_body
+            & (FDEVENT_STREAM_RESPONSE | FDEVENT_STREAM_RESPONSE_POLLRDHUP))
+           == FDEVENT_STREAM_RESPONSE;
+}
+
+int http_chunk_mem_pause(const request_st * const r) {
+    /*(pause only while data is pending to client, to ensure progress)*/
+    return http_chunk_mem_pausable(r)
+        && r->resp_body_started
+        && !chunkqueue_is_empty(&r->write_queue)
+        && http_chunk_mem_exceeded(r, 0);
+}
+
 static int http_chunk_uses_tempfile(const request_st * const r, const chunkqueue * const cq, const size_t len) {
 
     /* current usage does not append_mem or append_buffer after appending
@@ -230,12 +277,22 @@ static int http_chunk_uses_tempfile(const request_st * const r, const chunkqueue
      * blocked until more data is sent to network to client)*/
 
     const chunk * const c = cq->last;
-    return
-      ((c && c->type == FILE_CHUNK && c->file.is_temp)
-       || chunkqueue_length(cq) + len
-          > ((r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE_BUFMIN)
-             ? 128*1024
-             :  64*1024));
+    if (c && c->type == FILE_CHUNK && c->file.is_temp)
+        return 1;
+    if (0 == r->con->srv->srvconf.max_request_mem
+        && chunkqueue_length(cq) + len
+           > ((r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE_BUFMIN)
+              ? 128*1024
+              :  64*1024))
+        return 1;
+    /* spill to temp files if memory caps exceeded, unless reading from
+     * backend is paused instead (see http_chunk_mem_pause()); memory use
+     * of streamed response might then exceed caps by up to one read */
+    if (http_chunk_mem_exceeded(r, len) && !http_chunk_mem_pausable(r)) {
+        status_counter_inc(CONST_STR_LEN("chunkqueue.mem-spills"));
+        return 1;
+    }
+    return 0;
 }
 
 int http_chunk_append_buffer(request_st * const r, buffer * const mem) {
@@ -21,4 +21,10 @@ void http_chunk_append_file_fd_range(request_st *r, const buffer *fn, int fd, of
 void http_chunk_append_file_ref_range(request_st *r, struct stat_cache_entry *sce, off_t offset, off_t len); /* copies "fn" */
 void http_chunk_close(request_st *r);
 
+/* memory caps (server.max-request-mem, server.max-connection-mem,
+ * server.max-mem); returns 1 if reading streamed response from backend
+ * should pause until pending response data is sent to client
+ * (response data which is not streamed is spilled to temp files instead) */
+int http_chunk_mem_pause(const request_st *r);
+
 #endif
@@ -762,13 +762,30 @@ static int cgi_create_env(request_st * const r, plugin_data * const p, handler_c
 		}
 	}
 
-	if (pipe_cloexec(to_cgi_fds)) {
+	/* pass request body temp file directly to CGI as stdin if request body
+	 * has been received completely and is contained in single temp file */
+	chunkqueue * const cq = &r->reqbody_queue;
+	const chunk * const c = cq->first;
+	const int reqbody_tmpfile =
+	  (0 != r->reqbody_length && !hctx->conf.upgrade
+	   && cq->bytes_in == (off_t)r->reqbody_length && 0 == cq->bytes_out
+	   && NULL != c && c == cq->last && c->type == FILE_CHUNK
+	   && c->file.is_temp && c->file.fd >= 0
+	   && -1 != lseek(c->file.fd, c->offset, SEEK_SET));
+
+	if (reqbody_tmpfile) {
+		to_cgi_fds[0] = c->file.fd; /*(fd remains owned by chunk)*/
+		to_cgi_fds[1] = -1;
+	}
+	else if (pipe_cloexec(to_cgi_fds)) {
 		log_perror(r->conf.errh, __FILE__, __LINE__, "pipe failed");
 		return -1;
 	}
 	if (pipe_cloexec(from_cgi_fds)) {
-		close(to_cgi_fds[0]);
-		close(to_cgi_fds[1]);
+		if (!reqbody_tmpfile) {
+			close(to_cgi_fds[0]);
+			close(to_cgi_fds[1]);
+		}
 		log_perror(r->conf.errh, __FILE__, __LINE__, "pipe failed");
 		return -1;
 	}
@@ -832,19 +849,25 @@ static int cgi_create_env(request_st * const r, plugin_data * const p, handler_c
 		if (-1 != dfd) close(dfd);
 		close(from_cgi_fds[0]);
 		close(from_cgi_fds[1]);
-		close(to_cgi_fds[0]);
-		close(to_cgi_fds[1]);
+		if (!reqbody_tmpfile) {
+			close(to_cgi_fds[0]);
+			close(to_cgi_fds[1]);
+		}
 		return -1;
 	} else {
 		if (-1 != dfd) close(dfd);
 		close(from_cgi_fds[1]);
-		close(to_cgi_fds[0]);
+		if (!reqbody_tmpfile) close(to_cgi_fds[0]);
 
 		hctx->fd = from_cgi_fds[0];
 
 		cgi_pid_add(p, hctx->pid, hctx);
 
-		if (0 == r->reqbody_length) {
+		if (reqbody_tmpfile) {
+			/* CGI reads request body from (dup of) temp file fd */
+			chunkqueue_mark_written(cq, chunkqueue_length(cq));
+		}
+		else if (0 == r->reqbody_length) {
 			close(to_cgi_fds[1]);
 		}
 		else if (0 == fdevent_fcntl_set_nb(to_cgi_fds[1])
@@ -946,9 +969,13 @@ SUBREQUEST_FUNC(mod_cgi_handle_subrequest) {
 
 	if (2 == hctx->conf.local_redir) return mod_cgi_local_redir(r);
 
-	if ((r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE_BUFMIN)
+	if ((r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE)
 	    && r->resp_body_started) {
-		if (chunkqueue_length(&r->write_queue) > 65536 - 4096) {
+		if ((r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE_BUFMIN)
+		    && chunkqueue_length(&r->write_queue) > 65536 - 4096) {
+			fdevent_fdnode_event_clr(hctx->ev, hctx->fdn, FDEVENT_IN);
+		} else if (http_chunk_mem_pause(r)) {
+			/* memory caps exceeded (server.max-*-mem) */
 			fdevent_fdnode_event_clr(hctx->ev, hctx->fdn, FDEVENT_IN);
 		} else if (!(fdevent_fdnode_interest(hctx->fdn) & FDEVENT_IN)) {
 			/* optimistic read from backend */
@@ -116,6 +116,7 @@
 #include "etag.h"
 #include "http_chunk.h"
 #include "http_header.h"
+#include "reqpool.h"
 #include "response.h"
 #include "stat_cache.h"
 
@@ -216,10 +217,11 @@ typedef struct {
 	chunkqueue in_queue;
 } handler_ctx;
 
-static handler_ctx *handler_ctx_init() {
+static handler_ctx *handler_ctx_init(request_st * const r) {
 	handler_ctx *hctx;
 
-	hctx = calloc(1, sizeof(*hctx));
+	/*(request-lifetime; released with r->arena in request_reset())*/
+	hctx = request_arena_calloc(r, sizeof(*hctx));
 	chunkqueue_init(&hctx->in_queue);
 	hctx->cache_fd = -1;
 
@@ -239,7 +241,7 @@ static void handler_ctx_free(handler_ctx *hctx) {
 	}
       #endif
 	chunkqueue_reset(&hctx->in_queue);
-	free(hctx);
+	/*(hctx memory is in r->arena)*/
 }
 
 INIT_FUNC(mod_deflate_init) {
@@ -1555,7 +1557,7 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 	  ((r->conf.stream_response_body
 	    & (FDEVENT_STREAM_RESPONSE | FDEVENT_STREAM_RESPONSE_BUFMIN))
 	   && 0 == p->conf.output_buffer_size);
-	hctx = handler_ctx_init();
+	hctx = handler_ctx_init(r);
 	hctx->plugin_data = p;
 	hctx->compression_type = compression_type;
 	hctx->r = r;
@@ -86,6 +86,12 @@
 #include <openssl/core_names.h>
 #endif
 
+/* kernel TLS offload (openssl 3.0.0+ built with ktls support) */
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS) \
+ && defined(BIO_get_ktls_send)
+#define MOD_OPENSSL_KTLS
+#endif
+
 #include "base.h"
 #include "fdevent.h"
 #include "http_header.h"
@@ -93,6 +99,7 @@
 #include "log.h"
 #include "plugin.h"
 #include "safe_memclear.h"
+#include "status_counter.h"
 
 typedef struct {
     /* SNI per host: with COMP_SERVER_SOCKET, COMP_HTTP_SCHEME, COMP_HTTP_HOST */
@@ -184,6 +191,7 @@ typedef struct {
     short renegotiations; /* count of SSL_CB_HANDSHAKE_START */
     short close_notify;
     unsigned short alpn;
+    unsigned char ktls; /* MOD_OPENSSL_KTLS_* flags */
     plugin_config conf;
     buffer *tmp_buf;
     log_error_st *errh;
@@ -2061,6 +2069,13 @@ network_init_ssl (server *srv, plugin_config_socket *s, plugin_data *p)
                         | SSL_OP_NO_SESSION_RESUMPTION_ON_RENEGOTIATION
                         | SSL_OP_NO_COMPRESSION;
 
+      #ifdef MOD_OPENSSL_KTLS
+        /* kernel TLS offload, if supported by kernel (Linux "tls" module)
+         * and negotiated cipher; openssl falls back to userspace otherwise
+         * (disable with ssl.openssl.ssl-conf-cmd = ("Options" => "-KTLS")) */
+        ssloptions |= SSL_OP_ENABLE_KTLS;
+      #endif
+
       #if OPENSSL_VERSION_NUMBER >= 0x10100000L
         s->ssl_ctx = (!s->ssl_use_sslv2 && !s->ssl_use_sslv3)
           ? SSL_CTX_new(TLS_server_method())
@@ -2849,6 +2864,29 @@ static int
 mod_openssl_close_notify(handler_ctx *hctx);
 
 
+#define MOD_OPENSSL_KTLS_CHECKED 0x1
+#define MOD_OPENSSL_KTLS_TX      0x2
+#define MOD_OPENSSL_KTLS_RX      0x4
+
+static void
+mod_openssl_ktls_check (handler_ctx * const hctx)
+{
+    /* check once, after handshake, if kernel TLS offload is active */
+    hctx->ktls = MOD_OPENSSL_KTLS_CHECKED;
+    status_counter_inc(CONST_STR_LEN("openssl.ktls.checked"));
+  #ifdef MOD_OPENSSL_KTLS
+    if (BIO_get_ktls_send(SSL_get_wbio(hctx->ssl))) {
+        hctx->ktls |= MOD_OPENSSL_KTLS_TX;
+        status_counter_inc(CONST_STR_LEN("openssl.ktls.tx"));
+    }
+    if (BIO_get_ktls_recv(SSL_get_rbio(hctx->ssl))) {
+        hctx->ktls |= MOD_OPENSSL_KTLS_RX;
+        status_counter_inc(CONST_STR_LEN("openssl.ktls.rx"));
+    }
+  #endif
+}
+
+
 static int
 connection_write_cq_ssl (connection *con, chunkqueue *cq, off_t max_bytes)
 {
@@ -2858,6 +2896,9 @@ connection_write_cq_ssl (connection *con, chunkqueue *cq, off_t max_bytes)
 
     if (0 != hctx->close_notify) return mod_openssl_close_notify(hctx);
 
+    if (!hctx->ktls && SSL_is_init_finished(ssl))
+        mod_openssl_ktls_check(hctx);
+
     chunkqueue_remove_finished_chunks(cq);
 
     while (max_bytes > 0 && !chunkqueue_is_empty(cq)) {
@@ -2867,19 +2908,36 @@ connection_write_cq_ssl (connection *con, chunkqueue *cq, off_t max_bytes)
           : (uint32_t)max_bytes;
         int wr;
 
-        if (0 != chunkqueue_peek_data(cq, &data, &data_len, errh)) return -1;
+      #ifdef MOD_OPENSSL_KTLS
+        chunk * const c = cq->first;
+        if (c->type == FILE_CHUNK && (hctx->ktls & MOD_OPENSSL_KTLS_TX)) {
+            /* kernel encrypts; send file without copying into userspace */
+            if (0 != chunkqueue_open_file_chunk(cq, errh)) return -1;
+            off_t len = c->file.length - c->offset;
+            if (len > max_bytes) len = max_bytes;
+            if (len > INT_MAX) len = INT_MAX;
+            data_len = (uint32_t)len;
+            ERR_clear_error();
+            wr = (int)SSL_sendfile(ssl, c->file.fd, c->offset, data_len, 0);
+        }
+        else
+      #endif
+        {
+            if (0 != chunkqueue_peek_data(cq, &data, &data_len, errh))
+                return -1;
 
-        /**
-         * SSL_write man-page
-         *
-         * WARNING
-         *        When an SSL_write() operation has to be repeated because of
-         *        SSL_ERROR_WANT_READ or SSL_ERROR_WANT_WRITE, it must be
-         *        repeated with the same arguments.
-         */
+            /**
+             * SSL_write man-page
+             *
+             * WARNING
+             *        When an SSL_write() operation has to be repeated because
+             *        of SSL_ERROR_WANT_READ or SSL_ERROR_WANT_WRITE, it must
+             *        be repeated with the same arguments.
+             */
 
-        ERR_clear_error();
-        wr = SSL_write(ssl, data, data_len);
+            ERR_clear_error();
+            wr = SSL_write(ssl, data, data_len);
+        }
 
         if (hctx->renegotiations > 1
             && hctx->conf.ssl_disable_client_renegotiation) {
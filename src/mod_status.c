@@ -7,15 +7,74 @@
 #include "log.h"
 
 #include "plugin.h"
+#include "status_counter.h"
 
 #include <sys/types.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include <fcntl.h>
+#include <stddef.h>     /* offsetof() */
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <stdio.h>
 
+/* statistics shared between workers (server.max-worker > 0)
+ *
+ * Each worker owns a slot in a MAP_SHARED segment created by the master prior
+ * to fork().  A worker publishes its counters, connection states and a copy of
+ * its status counters (e.g. gw.backend.* from gw_status_get_counter()) into
+ * its slot once per second (and when serving a status page), bracketed by a
+ * per-slot sequence counter (seqlock), so that readers in any worker obtain a
+ * consistent snapshot without locking.  The master folds the totals from an
+ * exited worker into the segment header so that totals persist. */
+#if defined(HAVE_MMAP) && defined(MAP_SHARED) && defined(MAP_ANONYMOUS) \
+ && (defined(__GNUC__) || defined(__clang__))
+#define MOD_STATUS_SHM
+#endif
+
+#define MOD_STATUS_CSTATES (CON_STATE_CLOSE+3) /*(+unknown, +keep-alive)*/
+#define MOD_STATUS_KEEPALIVE (CON_STATE_CLOSE+2)
+
+typedef struct {
+    double requests;
+    double traffic_out;
+    double requests_5s;    /* 5s sliding average */
+    double traffic_out_5s; /* 5s sliding average */
+    uint32_t busy;
+    uint32_t idle;
+    uint32_t cstates[MOD_STATUS_CSTATES];
+} mod_status_totals;
+
+#ifdef MOD_STATUS_SHM
+
+#define MOD_STATUS_SHM_STATS 256
+
+typedef struct {
+    char key[124];
+    int value;
+} mod_status_shm_stat;
+
+typedef struct {
+    pid_t pid;           /* worker owning slot; 0 if slot is free */
+    uint32_t seq;        /* odd while slot is being updated */
+    uint32_t nstats;
+    mod_status_totals t;
+    mod_status_shm_stat stats[MOD_STATUS_SHM_STATS];
+} mod_status_shm_worker;
+
+typedef struct {
+    uint32_t seq;        /* odd while master folds exited worker into totals */
+    uint32_t nworkers;
+    double retired_requests;
+    double retired_traffic_out;
+    mod_status_shm_worker w[];
+} mod_status_shm;
+
+#endif
+
 typedef struct {
     const buffer *config_url;
     const buffer *status_url;
@@ -43,12 +102,28 @@ typedef struct {
 	double abs_requests;
 
 	double bytes_written;
+
+  #ifdef MOD_STATUS_SHM
+	mod_status_shm *shm;
+	size_t shm_sz;
+	mod_status_shm_worker *slot;
+	pid_t master_pid;
+  #endif
 } plugin_data;
 
 INIT_FUNC(mod_status_init) {
     return calloc(1, sizeof(plugin_data));
 }
 
+FREE_FUNC(mod_status_free) {
+  #ifdef MOD_STATUS_SHM
+    plugin_data * const p = p_d;
+    if (p->shm) munmap(p->shm, p->shm_sz);
+  #else
+    UNUSED(p_d);
+  #endif
+}
+
 static void mod_status_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
     switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
       case 0: /* status.status-url */
@@ -115,6 +190,26 @@ SETDEFAULTS_FUNC(mod_status_set_defaults) {
             mod_status_merge_config(&p->defaults, cpv);
     }
 
+  #ifdef MOD_STATUS_SHM
+    /* (set_defaults runs in master prior to fork() of workers) */
+    if (srv->srvconf.max_worker) {
+        p->shm_sz = sizeof(mod_status_shm)
+                  + srv->srvconf.max_worker * sizeof(mod_status_shm_worker);
+        p->shm = mmap(NULL, p->shm_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == p->shm) {
+            log_perror(srv->errh, __FILE__, __LINE__,
+              "mmap() shared statistics for %hu workers; "
+              "status will report per-worker statistics",
+              srv->srvconf.max_worker);
+            p->shm = NULL;
+        }
+        else
+            p->shm->nworkers = srv->srvconf.max_worker;
+        p->master_pid = srv->pid;
+    }
+  #endif
+
     return HANDLER_GO_ON;
 }
 
@@ -160,6 +255,192 @@ mod_status_get_short_state (request_state_t state)
 }
 
 
+static void
+mod_status_count_states (server * const srv, mod_status_totals * const t)
+{
+    memset(t->cstates, 0, sizeof(t->cstates));
+    for (uint32_t i = 0; i < srv->conns.used; ++i) {
+        const connection * const c = srv->conns.ptr[i];
+        const request_st * const cr = &c->request;
+        if ((c->h2 && 0 == c->h2->rused)
+            || (CON_STATE_READ == cr->state
+                && !buffer_string_is_empty(&cr->target_orig)))
+            ++t->cstates[MOD_STATUS_KEEPALIVE];
+        else
+            ++t->cstates[(cr->state <= CON_STATE_CLOSE
+                          ? cr->state
+                          : CON_STATE_CLOSE+1)];
+    }
+    t->busy = srv->conns.used;
+    t->idle = srv->conns.size - srv->conns.used;
+}
+
+
+static void
+mod_status_local_totals (server * const srv, plugin_data * const p, mod_status_totals * const t)
+{
+    t->requests    = p->abs_requests;
+    t->traffic_out = p->abs_traffic_out;
+    t->requests_5s = 0;
+    t->traffic_out_5s = 0;
+    for (int j = 0; j < 5; ++j) {
+        t->requests_5s    += p->mod_5s_requests[j];
+        t->traffic_out_5s += p->mod_5s_traffic_out[j];
+    }
+    t->requests_5s    /= 5;
+    t->traffic_out_5s /= 5;
+    mod_status_count_states(srv, t);
+}
+
+
+static void
+mod_status_totals_add (mod_status_totals * const agg, const mod_status_totals * const t)
+{
+    agg->requests       += t->requests;
+    agg->traffic_out    += t->traffic_out;
+    agg->requests_5s    += t->requests_5s;
+    agg->traffic_out_5s += t->traffic_out_5s;
+    agg->busy           += t->busy;
+    agg->idle           += t->idle;
+    for (int j = 0; j < MOD_STATUS_CSTATES; ++j)
+        agg->cstates[j] += t->cstates[j];
+}
+
+
+#ifdef MOD_STATUS_SHM
+
+static mod_status_shm_worker *
+mod_status_shm_slot (server * const srv, plugin_data * const p)
+{
+    if (p->slot) return p->slot;
+    if (NULL == p->shm || srv->pid == p->master_pid) return NULL;
+    for (uint32_t i = 0; i < p->shm->nworkers; ++i) {
+        pid_t pid = 0;
+        if (__atomic_compare_exchange_n(&p->shm->w[i].pid, &pid, srv->pid, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            return (p->slot = p->shm->w+i);
+    }
+    return NULL;
+}
+
+
+static void
+mod_status_shm_publish (server * const srv, plugin_data * const p)
+{
+    mod_status_shm_worker * const w = mod_status_shm_slot(srv, p);
+    if (NULL == w) return;
+
+    const uint32_t seq = w->seq;
+    __atomic_store_n(&w->seq, seq+1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    mod_status_local_totals(srv, p, &w->t);
+
+    /* copy status counters (skip keys too long for slot) */
+    const array * const st = &plugin_stats;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < st->used && n < MOD_STATUS_SHM_STATS; ++i) {
+        const data_integer * const di = (data_integer *)st->data[i];
+        const uint32_t klen = buffer_string_length(&di->key);
+        if (klen >= sizeof(w->stats[0].key)) continue;
+        memcpy(w->stats[n].key, di->key.ptr, klen+1);
+        w->stats[n].value = di->value;
+        ++n;
+    }
+    w->nstats = n;
+
+    __atomic_store_n(&w->seq, seq+2, __ATOMIC_RELEASE);
+}
+
+
+static const mod_status_shm_worker *
+mod_status_shm_snap (const plugin_data * const p, const uint32_t i, const int with_stats)
+{
+    /* own slot is consistent (single writer) and is published by caller */
+    const mod_status_shm_worker * const w = p->shm->w+i;
+    if (w == p->slot) return w;
+
+    static mod_status_shm_worker snap;
+    for (int retry = 0; retry < 64; ++retry) {
+        const uint32_t seq = __atomic_load_n(&w->seq, __ATOMIC_ACQUIRE);
+        memcpy(&snap, w, offsetof(mod_status_shm_worker, stats));
+        if (snap.nstats > MOD_STATUS_SHM_STATS) snap.nstats = 0;
+        if (with_stats)
+            memcpy(snap.stats, w->stats, snap.nstats * sizeof(*w->stats));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (!(seq & 1) && seq == __atomic_load_n(&w->seq, __ATOMIC_RELAXED))
+            break;
+    }
+    if (!with_stats) snap.nstats = 0;
+    return snap.pid ? &snap : NULL;
+}
+
+
+static handler_t
+mod_status_handle_waitpid (server *srv, void *p_d, pid_t pid, int status)
+{
+    /* master: fold totals from exited worker into segment header and
+     * release slot for replacement worker */
+    plugin_data * const p = p_d;
+    mod_status_shm * const shm = p->shm;
+    if (NULL == shm || srv->pid != p->master_pid) return HANDLER_GO_ON;
+    UNUSED(status);
+
+    for (uint32_t i = 0; i < shm->nworkers; ++i) {
+        mod_status_shm_worker * const w = shm->w+i;
+        if (w->pid != pid) continue;
+
+        const uint32_t seq = shm->seq;
+        const uint32_t wseq = w->seq | 1; /*(worker might have died mid-update)*/
+        __atomic_store_n(&shm->seq, seq+1, __ATOMIC_RELAXED);
+        __atomic_store_n(&w->seq, wseq, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        shm->retired_requests    += w->t.requests;
+        shm->retired_traffic_out += w->t.traffic_out;
+        memset(&w->t, 0, sizeof(w->t));
+        w->nstats = 0;
+
+        __atomic_store_n(&w->pid, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&w->seq, wseq+1, __ATOMIC_RELEASE);
+        __atomic_store_n(&shm->seq, seq+2, __ATOMIC_RELEASE);
+        break;
+    }
+
+    return HANDLER_GO_ON;
+}
+
+#endif /* MOD_STATUS_SHM */
+
+
+static void
+mod_status_aggregate (server * const srv, plugin_data * const p, mod_status_totals * const agg)
+{
+  #ifdef MOD_STATUS_SHM
+    mod_status_shm * const shm = p->shm;
+    if (shm && srv->pid != p->master_pid) {
+        mod_status_shm_publish(srv, p);
+        for (int retry = 0; retry < 64; ++retry) {
+            const uint32_t seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+            memset(agg, 0, sizeof(*agg));
+            agg->requests    = shm->retired_requests;
+            agg->traffic_out = shm->retired_traffic_out;
+            for (uint32_t i = 0; i < shm->nworkers; ++i) {
+                const mod_status_shm_worker * const w =
+                  mod_status_shm_snap(p, i, 0);
+                if (w) mod_status_totals_add(agg, &w->t);
+            }
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (!(seq & 1) && seq == __atomic_load_n(&shm->seq, __ATOMIC_RELAXED))
+                break;
+        }
+        return;
+    }
+  #endif
+    mod_status_local_totals(srv, p, agg);
+}
+
+
 static int mod_status_row_append(buffer *b, const char *key, const char *value) {
 	buffer_append_string_len(b, CONST_STR_LEN("   <tr>\n"));
 	buffer_append_string_len(b, CONST_STR_LEN("    <td><b>"));
@@ -625,22 +906,36 @@ static handler_t mod_status_handle_server_status_html(server *srv, request_st *
 }
 
 
+static void mod_status_scoreboard_append(buffer * const b, const mod_status_totals * const t) {
+	/* (synthesized from connection state counts; order is not preserved) */
+	for (uint32_t j = 0; j < CON_STATE_CLOSE+2; ++j) {
+		for (uint32_t n = 0; n < t->cstates[j]; ++n)
+			buffer_append_string_len(b, mod_status_get_short_state(j), 1);
+	}
+	for (uint32_t n = 0; n < t->cstates[MOD_STATUS_KEEPALIVE]; ++n)
+		buffer_append_string_len(b, CONST_STR_LEN("k"));
+	for (uint32_t n = 0; n < t->idle; ++n)
+		buffer_append_string_len(b, CONST_STR_LEN("_"));
+}
+
+
 static handler_t mod_status_handle_server_status_text(server *srv, request_st * const r, plugin_data *p) {
 	buffer *b = chunkqueue_append_buffer_open(&r->write_queue);
-	double avg;
+	mod_status_totals t;
 	char buf[32];
 
+	/* totals are aggregated across all workers (server.max-worker) */
+	mod_status_aggregate(srv, p, &t);
+
 	/* output total number of requests */
 	buffer_append_string_len(b, CONST_STR_LEN("Total Accesses: "));
-	avg = p->abs_requests;
-	snprintf(buf, sizeof(buf) - 1, "%.0f", avg);
+	snprintf(buf, sizeof(buf) - 1, "%.0f", t.requests);
 	buffer_append_string(b, buf);
 	buffer_append_string_len(b, CONST_STR_LEN("\n"));
 
 	/* output total traffic out in kbytes */
 	buffer_append_string_len(b, CONST_STR_LEN("Total kBytes: "));
-	avg = p->abs_traffic_out / 1024;
-	snprintf(buf, sizeof(buf) - 1, "%.0f", avg);
+	snprintf(buf, sizeof(buf) - 1, "%.0f", t.traffic_out / 1024);
 	buffer_append_string(b, buf);
 	buffer_append_string_len(b, CONST_STR_LEN("\n"));
 
@@ -651,30 +946,81 @@ static handler_t mod_status_handle_server_status_text(server *srv, request_st *
 
 	/* output busy servers */
 	buffer_append_string_len(b, CONST_STR_LEN("BusyServers: "));
-	buffer_append_int(b, srv->conns.used);
+	buffer_append_int(b, t.busy);
 	buffer_append_string_len(b, CONST_STR_LEN("\n"));
 
 	buffer_append_string_len(b, CONST_STR_LEN("IdleServers: "));
-	buffer_append_int(b, srv->conns.size - srv->conns.used);
+	buffer_append_int(b, t.idle);
 	buffer_append_string_len(b, CONST_STR_LEN("\n"));
 
 	/* output scoreboard */
 	buffer_append_string_len(b, CONST_STR_LEN("Scoreboard: "));
-	for (uint32_t i = 0; i < srv->conns.used; ++i) {
-		connection *c = srv->conns.ptr[i];
-		const request_st * const cr = &c->request;
-		const char *state =
-		  ((c->h2 && 0 == c->h2->rused)
-		   || (CON_STATE_READ == cr->state && !buffer_string_is_empty(&cr->target_orig)))
-		    ? "k"
-		    : mod_status_get_short_state(cr->state);
-		buffer_append_string_len(b, state, 1);
+  #ifdef MOD_STATUS_SHM
+	if (p->slot) {
+		mod_status_scoreboard_append(b, &t);
 	}
-	for (uint32_t i = 0; i < srv->conns.size - srv->conns.used; ++i) {
-		buffer_append_string_len(b, CONST_STR_LEN("_"));
+	else
+  #endif
+	{
+		for (uint32_t i = 0; i < srv->conns.used; ++i) {
+			connection *c = srv->conns.ptr[i];
+			const request_st * const cr = &c->request;
+			const char *state =
+			  ((c->h2 && 0 == c->h2->rused)
+			   || (CON_STATE_READ == cr->state && !buffer_string_is_empty(&cr->target_orig)))
+			    ? "k"
+			    : mod_status_get_short_state(cr->state);
+			buffer_append_string_len(b, state, 1);
+		}
+		for (uint32_t i = 0; i < srv->conns.size - srv->conns.used; ++i) {
+			buffer_append_string_len(b, CONST_STR_LEN("_"));
+		}
 	}
 	buffer_append_string_len(b, CONST_STR_LEN("\n"));
 
+  #ifdef MOD_STATUS_SHM
+	/* output per-worker breakdown */
+	if (p->slot) {
+		uint32_t nworkers = 0;
+		for (uint32_t i = 0; i < p->shm->nworkers; ++i) {
+			const mod_status_shm_worker * const w = mod_status_shm_snap(p, i, 0);
+			if (NULL == w) continue;
+			++nworkers;
+
+			buffer_append_string_len(b, CONST_STR_LEN("Worker"));
+			buffer_append_int(b, i);
+			buffer_append_string_len(b, CONST_STR_LEN("Pid: "));
+			buffer_append_int(b, w->pid);
+
+			buffer_append_string_len(b, CONST_STR_LEN("\nWorker"));
+			buffer_append_int(b, i);
+			buffer_append_string_len(b, CONST_STR_LEN("Accesses: "));
+			snprintf(buf, sizeof(buf) - 1, "%.0f", w->t.requests);
+			buffer_append_string(b, buf);
+
+			buffer_append_string_len(b, CONST_STR_LEN("\nWorker"));
+			buffer_append_int(b, i);
+			buffer_append_string_len(b, CONST_STR_LEN("kBytes: "));
+			snprintf(buf, sizeof(buf) - 1, "%.0f", w->t.traffic_out / 1024);
+			buffer_append_string(b, buf);
+
+			buffer_append_string_len(b, CONST_STR_LEN("\nWorker"));
+			buffer_append_int(b, i);
+			buffer_append_string_len(b, CONST_STR_LEN("BusyServers: "));
+			buffer_append_int(b, w->t.busy);
+
+			buffer_append_string_len(b, CONST_STR_LEN("\nWorker"));
+			buffer_append_int(b, i);
+			buffer_append_string_len(b, CONST_STR_LEN("IdleServers: "));
+			buffer_append_int(b, w->t.idle);
+			buffer_append_string_len(b, CONST_STR_LEN("\n"));
+		}
+		buffer_append_string_len(b, CONST_STR_LEN("Workers: "));
+		buffer_append_int(b, nworkers);
+		buffer_append_string_len(b, CONST_STR_LEN("\n"));
+	}
+  #endif
+
 	chunkqueue_append_buffer_commit(&r->write_queue);
 
 	/* set text/plain output */
@@ -684,11 +1030,43 @@ static handler_t mod_status_handle_server_status_text(server *srv, request_st *
 }
 
 
+static void mod_status_json_totals_append(buffer * const b, const mod_status_totals * const t, const char * const sep) {
+	char buf[32];
+	const size_t slen = strlen(sep);
+
+	/* output total number of requests */
+	buffer_append_string_len(b, CONST_STR_LEN("\"RequestsTotal\": "));
+	snprintf(buf, sizeof(buf) - 1, "%.0f", t->requests);
+	buffer_append_string(b, buf);
+	buffer_append_string_len(b, sep, slen);
+
+	/* output total traffic out in kbytes */
+	buffer_append_string_len(b, CONST_STR_LEN("\"TrafficTotal\": "));
+	snprintf(buf, sizeof(buf) - 1, "%.0f", t->traffic_out / 1024);
+	buffer_append_string(b, buf);
+	buffer_append_string_len(b, sep, slen);
+
+	/* output busy servers */
+	buffer_append_string_len(b, CONST_STR_LEN("\"BusyServers\": "));
+	buffer_append_int(b, t->busy);
+	buffer_append_string_len(b, sep, slen);
+
+	buffer_append_string_len(b, CONST_STR_LEN("\"IdleServers\": "));
+	buffer_append_int(b, t->idle);
+	buffer_append_string_len(b, sep, slen);
+
+	buffer_append_string_len(b, CONST_STR_LEN("\"RequestAverage5s\":"));
+	buffer_append_int(b, t->requests_5s);
+	buffer_append_string_len(b, sep, slen);
+
+	buffer_append_string_len(b, CONST_STR_LEN("\"TrafficAverage5s\":"));
+	buffer_append_int(b, t->traffic_out_5s / 1024); /* kbps */
+}
+
+
 static handler_t mod_status_handle_server_status_json(server *srv, request_st * const r, plugin_data *p) {
 	buffer *b = chunkqueue_append_buffer_open(&r->write_queue);
-	double avg;
-	char buf[32];
-	uint32_t j;
+	mod_status_totals t;
 	unsigned int jsonp = 0;
 
 	if (buffer_string_length(&r->uri.query) >= sizeof("jsonp=")-1
@@ -706,18 +1084,11 @@ static handler_t mod_status_handle_server_status_json(server *srv, request_st *
 		}
 	}
 
-	/* output total number of requests */
-	buffer_append_string_len(b, CONST_STR_LEN("{\n\t\"RequestsTotal\": "));
-	avg = p->abs_requests;
-	snprintf(buf, sizeof(buf) - 1, "%.0f", avg);
-	buffer_append_string(b, buf);
-	buffer_append_string_len(b, CONST_STR_LEN(",\n"));
+	/* totals are aggregated across all workers (server.max-worker) */
+	mod_status_aggregate(srv, p, &t);
 
-	/* output total traffic out in kbytes */
-	buffer_append_string_len(b, CONST_STR_LEN("\t\"TrafficTotal\": "));
-	avg = p->abs_traffic_out / 1024;
-	snprintf(buf, sizeof(buf) - 1, "%.0f", avg);
-	buffer_append_string(b, buf);
+	buffer_append_string_len(b, CONST_STR_LEN("{\n\t"));
+	mod_status_json_totals_append(b, &t, ",\n\t");
 	buffer_append_string_len(b, CONST_STR_LEN(",\n"));
 
 	/* output uptime */
@@ -725,33 +1096,41 @@ static handler_t mod_status_handle_server_status_json(server *srv, request_st *
 	buffer_append_int(b, log_epoch_secs - srv->startup_ts);
 	buffer_append_string_len(b, CONST_STR_LEN(",\n"));
 
-	/* output busy servers */
-	buffer_append_string_len(b, CONST_STR_LEN("\t\"BusyServers\": "));
-	buffer_append_int(b, srv->conns.used);
-	buffer_append_string_len(b, CONST_STR_LEN(",\n"));
-
-	buffer_append_string_len(b, CONST_STR_LEN("\t\"IdleServers\": "));
-	buffer_append_int(b, srv->conns.size - srv->conns.used);
-	buffer_append_string_len(b, CONST_STR_LEN(",\n"));
-
-	for (j = 0, avg = 0; j < 5; j++) {
-		avg += p->mod_5s_requests[j];
+	/* output connection states */
+	buffer_append_string_len(b, CONST_STR_LEN("\t\"ConnectionStates\": {"));
+	for (uint32_t j = 0; j < CON_STATE_CLOSE+1; ++j) {
+		buffer_append_string_len(b, CONST_STR_LEN("\""));
+		buffer_append_string(b, mod_status_get_state(j));
+		buffer_append_string_len(b, CONST_STR_LEN("\": "));
+		buffer_append_int(b, t.cstates[j]);
+		buffer_append_string_len(b, CONST_STR_LEN(", "));
 	}
-
-	avg /= 5;
-
-	buffer_append_string_len(b, CONST_STR_LEN("\t\"RequestAverage5s\":"));
-	buffer_append_int(b, avg);
-	buffer_append_string_len(b, CONST_STR_LEN(",\n"));
-
-	for (j = 0, avg = 0; j < 5; j++) {
-		avg += p->mod_5s_traffic_out[j];
+	buffer_append_string_len(b, CONST_STR_LEN("\"keep-alive\": "));
+	buffer_append_int(b, t.cstates[MOD_STATUS_KEEPALIVE]);
+	buffer_append_string_len(b, CONST_STR_LEN("}"));
+
+  #ifdef MOD_STATUS_SHM
+	/* output per-worker breakdown */
+	if (p->slot) {
+		int first = 1;
+		buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"Workers\": ["));
+		for (uint32_t i = 0; i < p->shm->nworkers; ++i) {
+			const mod_status_shm_worker * const w = mod_status_shm_snap(p, i, 0);
+			if (NULL == w) continue;
+			if (!first) buffer_append_string_len(b, CONST_STR_LEN(","));
+			first = 0;
+			buffer_append_string_len(b, CONST_STR_LEN("\n\t\t{\"Worker\": "));
+			buffer_append_int(b, i);
+			buffer_append_string_len(b, CONST_STR_LEN(", \"Pid\": "));
+			buffer_append_int(b, w->pid);
+			buffer_append_string_len(b, CONST_STR_LEN(", "));
+			mod_status_json_totals_append(b, &w->t, ", ");
+			buffer_append_string_len(b, CONST_STR_LEN("}"));
+		}
+		buffer_append_string_len(b, CONST_STR_LEN("\n\t]"));
 	}
+  #endif
 
-	avg /= 5;
-
-	buffer_append_string_len(b, CONST_STR_LEN("\t\"TrafficAverage5s\":"));
-	buffer_append_int(b, avg / 1024); /* kbps */
 	buffer_append_string_len(b, CONST_STR_LEN("\n}"));
 
 	if (jsonp) buffer_append_string_len(b, CONST_STR_LEN(");"));
@@ -765,16 +1144,71 @@ static handler_t mod_status_handle_server_status_json(server *srv, request_st *
 }
 
 
-static handler_t mod_status_handle_server_statistics(request_st * const r) {
+static void mod_status_pool_stats(void) {
+	/* memory in chunkqueues; chunk and buffer pools; heap fragmentation */
+	buffer_pool_stats_t bp;
+	buffer_pool_stats(&bp);
+	status_counter_set(CONST_STR_LEN("chunk.pool.chunks"),
+	                   (int)chunkqueue_chunk_pool_count());
+	status_counter_set(CONST_STR_LEN("chunkqueue.mem-kbytes"),
+	                   (int)(chunkqueue_mem_total() >> 10));
+	status_counter_set(CONST_STR_LEN("buffer.pool.blocks"),
+	                   (int)bp.pooled_blocks);
+	status_counter_set(CONST_STR_LEN("buffer.pool.classes"),
+	                   (int)bp.classes);
+	status_counter_set(CONST_STR_LEN("buffer.pool.kbytes"),
+	                   (int)(bp.pooled_bytes >> 10));
+	status_counter_set(CONST_STR_LEN("buffer.pool.hwm-kbytes"),
+	                   (int)(bp.hwm_bytes >> 10));
+	status_counter_set(CONST_STR_LEN("buffer.pool.hits"),
+	                   (int)bp.hits);
+	status_counter_set(CONST_STR_LEN("buffer.pool.misses"),
+	                   (int)bp.misses);
+	if (bp.heap_bytes) {
+		status_counter_set(CONST_STR_LEN("malloc.heap-kbytes"),
+		                   (int)(bp.heap_bytes >> 10));
+		status_counter_set(CONST_STR_LEN("malloc.free-kbytes"),
+		                   (int)(bp.heap_free >> 10));
+		status_counter_set(CONST_STR_LEN("malloc.fragmentation-pct"),
+		                   (int)(bp.heap_free * 100 / bp.heap_bytes));
+	}
+}
+
+
+static handler_t mod_status_handle_server_statistics(request_st * const r, plugin_data * const p) {
 	buffer *b;
 	size_t i;
 	array *st = &plugin_stats;
 
+	mod_status_pool_stats();
+
+  #ifdef MOD_STATUS_SHM
+	/* sum status counters across all workers (server.max-worker) */
+	array *agg = NULL;
+	mod_status_shm_publish(r->con->srv, p);
+	if (p->slot) {
+		st = agg = array_init(st->used);
+		for (uint32_t n = 0; n < p->shm->nworkers; ++n) {
+			const mod_status_shm_worker * const w = mod_status_shm_snap(p, n, 1);
+			if (NULL == w) continue;
+			for (uint32_t k = 0; k < w->nstats; ++k) {
+				const mod_status_shm_stat * const s = w->stats+k;
+				*array_get_int_ptr(agg, s->key, strlen(s->key)) += s->value;
+			}
+		}
+	}
+  #else
+	UNUSED(p);
+  #endif
+
 	if (0 == st->used) {
 		/* we have nothing to send */
 		r->http_status = 204;
 		r->resp_body_finished = 1;
 
+	  #ifdef MOD_STATUS_SHM
+		if (agg) array_free(agg);
+	  #endif
 		return HANDLER_FINISHED;
 	}
 
@@ -787,6 +1221,10 @@ static handler_t mod_status_handle_server_statistics(request_st * const r) {
 	}
 	chunkqueue_append_buffer_commit(&r->write_queue);
 
+  #ifdef MOD_STATUS_SHM
+	if (agg) array_free(agg);
+  #endif
+
 	http_header_response_set(r, HTTP_HEADER_CONTENT_TYPE, CONST_STR_LEN("Content-Type"), CONST_STR_LEN("text/plain"));
 
 	r->http_status = 200;
@@ -888,7 +1326,7 @@ static handler_t mod_status_handler(request_st * const r, void *p_d) {
 		return mod_status_handle_server_config(r);
 	} else if (!buffer_string_is_empty(p->conf.statistics_url) &&
 	    buffer_is_equal(p->conf.statistics_url, &r->uri.path)) {
-		return mod_status_handle_server_statistics(r);
+		return mod_status_handle_server_statistics(r, p);
 	}
 
 	return HANDLER_GO_ON;
@@ -919,6 +1357,10 @@ TRIGGER_FUNC(mod_status_trigger) {
 	p->traffic_out = 0;
 	p->requests    = 0;
 
+  #ifdef MOD_STATUS_SHM
+	if (p->shm) mod_status_shm_publish(srv, p);
+  #endif
+
 	return HANDLER_GO_ON;
 }
 
@@ -941,11 +1383,15 @@ int mod_status_plugin_init(plugin *p) {
 	p->name        = "status";
 
 	p->init        = mod_status_init;
+	p->cleanup     = mod_status_free;
 	p->set_defaults= mod_status_set_defaults;
 
 	p->handle_uri_clean    = mod_status_handler;
 	p->handle_trigger      = mod_status_trigger;
 	p->handle_request_done = mod_status_account;
+  #ifdef MOD_STATUS_SHM
+	p->handle_waitpid      = mod_status_handle_waitpid;
+  #endif
 
 	return 0;
 }
@@ -6,6 +6,7 @@
 #include "log.h"
 #include "connections.h"
 #include "plugin.h"
+#include "status_counter.h"
 #include "sock_addr.h"
 
 #include "network_write.h"
@@ -21,6 +22,10 @@
 #include <string.h>
 #include <stdlib.h>
 
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+#include <linux/filter.h>
+#endif
+
 void
 network_accept_tcp_nagle_disable (const int fd)
 {
@@ -55,16 +60,26 @@ static handler_t network_server_handle_fdevent(void *context, int revents) {
 		return HANDLER_ERROR;
 	}
 
-	/* accept()s at most 100 connections directly
+	/* accept()s at most server.accept-batch (default 100) connections
+	 * directly
 	 *
-	 * we jump out after 100 to give the waiting connections a chance */
+	 * we jump out after batch to give the waiting connections a chance */
+	status_counter_inc(CONST_STR_LEN("network.accept-wakeups"));
 	if (srv->conns.used >= srv->max_conns) return HANDLER_GO_ON;
 	loops = (int)(srv->max_conns - srv->conns.used + 1);
-	if (loops > 100) loops = 101;
+	if (loops > srv->srvconf.accept_batch) loops = srv->srvconf.accept_batch+1;
+	const int batch = loops;
 
 	while (--loops && NULL != (con = connection_accept(srv, srv_socket)))
 		connection_state_machine(con);
 
+	/* (per-process counters; each worker reports its own) */
+	if (batch - 1 == loops) /* woken, but another process accept()ed */
+		status_counter_inc(CONST_STR_LEN("network.accept-wakeups-empty"));
+	else
+		*status_counter_get_counter(CONST_STR_LEN("network.accepts"))
+		  += batch - 1 - loops;
+
 	return HANDLER_GO_ON;
 }
 
@@ -145,6 +160,7 @@ typedef struct {
     unsigned char use_ipv6;
     unsigned char set_v6only; /* set_v6only is only a temporary option */
     unsigned char defer_accept;
+    unsigned char reuseport;
     int8_t v4mapped;
     const buffer *socket_perms;
     const buffer *bsd_accept_filter;
@@ -182,6 +198,9 @@ static void network_merge_config_cpv(network_socket_config * const pconf, const
       case 7: /* server.v4mapped */
         pconf->v4mapped = (0 != cpv->v.u);
         break;
+      case 8: /* server.reuseport */
+        pconf->reuseport = (0 != cpv->v.u);
+        break;
       default:/* should not happen */
         return;
     }
@@ -364,6 +383,17 @@ static int network_server_init(server *srv, network_socket_config *s, buffer *ho
 		}
 	}
 
+#ifdef SO_REUSEPORT
+	if (-1 == stdin_fd && family != AF_UNIX
+	    && s->reuseport && srv->srvconf.max_worker > 1) {
+		int v = 1;
+		if (-1 == setsockopt(srv_socket->fd, SOL_SOCKET, SO_REUSEPORT, &v, sizeof(v))) {
+			log_perror(srv->errh, __FILE__, __LINE__, "setsockopt(SO_REUSEPORT)");
+			return -1;
+		}
+	}
+#endif
+
 	if (-1 != stdin_fd) { } else
 	if (0 != bind(srv_socket->fd, (struct sockaddr *) &(srv_socket->addr), addr_len)) {
 		log_perror(srv->errh, __FILE__, __LINE__,
@@ -422,6 +452,105 @@ static int network_server_init(server *srv, network_socket_config *s, buffer *ho
 	return 0;
 }
 
+#ifdef SO_REUSEPORT
+
+static int network_server_reuseport_socket(server *srv, network_socket_config *s, const server_socket *base) {
+	/* open additional listen socket in SO_REUSEPORT group of base socket */
+	const int family = sock_addr_get_family(&base->addr);
+	const int fd = fdevent_socket_nb_cloexec(family, SOCK_STREAM, IPPROTO_TCP);
+	int v = 1;
+	if (-1 == fd) {
+		log_perror(srv->errh, __FILE__, __LINE__, "socket");
+		return -1;
+	}
+
+#ifdef HAVE_IPV6
+	if (AF_INET6 == family) {
+		socklen_t vlen = sizeof(v);
+		if (0 != getsockopt(base->fd, IPPROTO_IPV6, IPV6_V6ONLY, &v, &vlen)
+		    || -1 == setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v, sizeof(v))) {
+			log_perror(srv->errh, __FILE__, __LINE__, "setsockopt(IPV6_V6ONLY)");
+			close(fd);
+			return -1;
+		}
+		v = 1;
+	}
+#endif
+
+	if (fdevent_set_so_reuseaddr(fd, 1) < 0
+	    || -1 == setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &v, sizeof(v))
+	    || fdevent_set_tcp_nodelay(fd, 1) < 0) {
+		log_perror(srv->errh, __FILE__, __LINE__, "setsockopt()");
+		close(fd);
+		return -1;
+	}
+
+	if (0 != bind(fd, (struct sockaddr *)&base->addr, sizeof(base->addr))
+	    || -1 == listen(fd, s->listen_backlog)) {
+		log_perror(srv->errh, __FILE__, __LINE__,
+		  "can't bind to socket: %s", base->srv_token->ptr);
+		close(fd);
+		return -1;
+	}
+
+#ifdef TCP_DEFER_ACCEPT
+	if (!s->ssl_enabled && s->defer_accept) {
+		v = s->defer_accept;
+		if (-1 == setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &v, sizeof(v))) {
+			log_perror(srv->errh, __FILE__, __LINE__, "can't set TCP_DEFER_ACCEPT");
+		}
+	}
+#endif
+
+	return fd;
+}
+
+static void network_server_init_reuseport(server *srv, network_socket_config *s, server_socket *base) {
+	/* server.reuseport: one listen socket per worker (server.max-worker)
+	 * in a SO_REUSEPORT group, so that the kernel distributes new
+	 * connections among workers instead of waking all workers to race
+	 * for accept() on a single shared listen socket */
+	if (!s->reuseport || srv->srvconf.max_worker < 2) return;
+	if (AF_UNIX == sock_addr_get_family(&base->addr)) return;
+	if (srv->sockets_disabled) return; /* lighttpd -1 (one-shot mode) */
+
+	for (int n = 1; n < srv->srvconf.max_worker; ++n) {
+		int fd = -1;
+
+		/* reuse sockets inherited from previous generation, if available */
+		if (srv->srvconf.systemd_socket_activation) {
+			for (uint32_t i = 0; i < srv->srv_sockets_inherited.used; ++i) {
+				server_socket * const srv_socket = srv->srv_sockets_inherited.ptr[i];
+				if ((unsigned short)~0u != srv_socket->sidx) continue;
+				if (0 != memcmp(&srv_socket->addr, &base->addr, sizeof(base->addr))) continue;
+				srv_socket->sidx = base->sidx;
+				fd = srv_socket->fd;
+				break;
+			}
+		}
+
+		if (-1 == fd && -1 == (fd = network_server_reuseport_socket(srv, s, base))) {
+			log_error(srv->errh, __FILE__, __LINE__,
+			  "server.reuseport: %d of %hu workers have own listen socket "
+			  "for %s; remaining workers share listen sockets",
+			  n, srv->srvconf.max_worker, base->srv_token->ptr);
+			return;
+		}
+
+		server_socket * const srv_socket = calloc(1, sizeof(*srv_socket));
+		force_assert(NULL != srv_socket);
+		memcpy(&srv_socket->addr, &base->addr, sizeof(base->addr));
+		srv_socket->fd = fd;
+		srv_socket->sidx = base->sidx;
+		srv_socket->is_ssl = base->is_ssl;
+		srv_socket->srv = srv;
+		srv_socket->srv_token = buffer_init_buffer(base->srv_token);
+		network_srv_sockets_append(srv, srv_socket);
+	}
+}
+
+#endif /* SO_REUSEPORT */
+
 int network_close(server *srv) {
 	for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
 		server_socket *srv_socket = srv->srv_sockets.ptr[i];
@@ -539,6 +668,324 @@ static int network_socket_activation_from_env(server *srv, network_socket_config
     return rc;
 }
 
+#if defined(HAVE_SYS_UN_H) && defined(SCM_RIGHTS)
+
+/* server.upgrade-socket: hand over listen sockets to new server (binary)
+ * on unix domain socket via SCM_RIGHTS, so that listen sockets are never
+ * closed and no pending or new connections are refused during upgrade */
+
+#define NETWORK_UPGRADE_MAGIC   0x6c757067u /* "lupg" */
+#define NETWORK_UPGRADE_VERSION 1u
+#define NETWORK_UPGRADE_BATCH   64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;    /* pid of previous generation (sender) */
+    uint32_t nfds;  /* total num listen sockets handed over */
+    uint32_t n;     /* num fds in this message */
+} network_upgrade_msg;
+
+static int network_upgrade_addr(struct sockaddr_un *un, const buffer *path) {
+    const size_t len = buffer_string_length(path);
+    if (len + 1 > sizeof(un->sun_path)) return -1;
+    memset(un, 0, sizeof(*un));
+    un->sun_family = AF_UNIX;
+    memcpy(un->sun_path, path->ptr, len + 1);
+    return 0;
+}
+
+__attribute_cold__
+static int network_upgrade_receive(server *srv) {
+    struct sockaddr_un un;
+    if (0 != network_upgrade_addr(&un, srv->srvconf.upgrade_socket)) {
+        log_error(srv->errh, __FILE__, __LINE__,
+          "server.upgrade-socket path too long: %s",
+          srv->srvconf.upgrade_socket->ptr);
+        return -1;
+    }
+
+    const int sfd = fdevent_socket_cloexec(AF_UNIX, SOCK_STREAM, 0);
+    if (-1 == sfd) {
+        log_perror(srv->errh, __FILE__, __LINE__, "socket");
+        return -1;
+    }
+    if (0 != connect(sfd, (struct sockaddr *)&un, sizeof(un))) {
+        /* no previous generation listening; start up normally */
+        close(sfd);
+        return 0;
+    }
+    struct timeval tv = { 5, 0 };
+    setsockopt(sfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    network_upgrade_msg hdr;
+    int fds[NETWORK_UPGRADE_BATCH];
+    uint32_t nfds = 1, rcvd = 0;
+    pid_t pid = 0;
+    union {
+        struct cmsghdr cm;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } ctl;
+    buffer * const host = buffer_init();
+    int rc = 0;
+    while (rcvd < nfds) {
+        struct iovec iov = { &hdr, sizeof(hdr) };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = sizeof(ctl.buf);
+        ssize_t rd;
+        do { rd = recvmsg(sfd, &msg, MSG_CMSG_CLOEXEC); }
+        while (-1 == rd && errno == EINTR);
+        if (rd <= 0) {
+            log_perror(srv->errh, __FILE__, __LINE__,
+              "server.upgrade-socket recvmsg()");
+            rc = -1;
+            break;
+        }
+
+        int n = 0;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+             cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+                continue;
+            n = (int)((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            memcpy(fds, CMSG_DATA(cm), n * sizeof(int));
+            break;
+        }
+
+        if (rd != sizeof(hdr) || hdr.magic != NETWORK_UPGRADE_MAGIC
+            || hdr.version != NETWORK_UPGRADE_VERSION
+            || (msg.msg_flags & (MSG_CTRUNC|MSG_TRUNC))
+            || hdr.n != (uint32_t)n || rcvd + hdr.n > hdr.nfds) {
+            log_error(srv->errh, __FILE__, __LINE__,
+              "server.upgrade-socket: invalid handover message");
+            for (int i = 0; i < n; ++i) close(fds[i]);
+            rc = -1;
+            break;
+        }
+        nfds = hdr.nfds;
+        pid = (pid_t)hdr.pid;
+
+        for (int i = 0; i < n; ++i) {
+            sock_addr addr;
+            socklen_t addr_len = sizeof(addr);
+            if (-1 == getsockname(fds[i], (struct sockaddr *)&addr, &addr_len)
+                || -1 == fdevent_fcntl_set_nb_cloexec(fds[i])) {
+                log_perror(srv->errh, __FILE__, __LINE__,
+                  "server.upgrade-socket fd");
+                close(fds[i]);
+                continue;
+            }
+            network_host_normalize_addr_str(host, &addr);
+            /* add directly to srv->srv_sockets_inherited (and not through
+             * network_server_init()) to keep each socket of SO_REUSEPORT
+             * group (multiple sockets bound to same addr) */
+            server_socket * const srv_socket = calloc(1, sizeof(*srv_socket));
+            force_assert(NULL != srv_socket);
+            memcpy(&srv_socket->addr, &addr, addr_len);
+            srv_socket->fd = fds[i];
+            srv_socket->sidx = (unsigned short)~0u;
+            srv_socket->srv = srv;
+            srv_socket->srv_token = buffer_init_buffer(host);
+            server_socket_array * const a = &srv->srv_sockets_inherited;
+            if (a->used == a->size) {
+                a->size += 4;
+                a->ptr = realloc(a->ptr, a->size * sizeof(server_socket *));
+                force_assert(NULL != a->ptr);
+            }
+            a->ptr[a->used++] = srv_socket;
+        }
+        rcvd += hdr.n;
+    }
+    buffer_free(host);
+    close(sfd);
+
+    if (0 != rc) return rc;
+
+    /* previous generation is signalled for graceful shutdown once
+     * this server is ready to accept new connections */
+    buffer * const tb = srv->tmp_buf;
+    buffer_clear(tb);
+    buffer_append_int(tb, pid);
+    setenv("LIGHTTPD_PREV_GEN", tb->ptr, 1);
+
+    log_error(srv->errh, __FILE__, __LINE__,
+      "[note] received %u listen sockets from pid %d",
+      srv->srv_sockets_inherited.used, (int)pid);
+    return (int)srv->srv_sockets_inherited.used;
+}
+
+int network_upgrade_listen(server *srv) {
+    struct sockaddr_un un;
+    if (0 != network_upgrade_addr(&un, srv->srvconf.upgrade_socket)) {
+        log_error(srv->errh, __FILE__, __LINE__,
+          "server.upgrade-socket path too long: %s",
+          srv->srvconf.upgrade_socket->ptr);
+        return -1;
+    }
+
+    const int fd = fdevent_socket_nb_cloexec(AF_UNIX, SOCK_STREAM, 0);
+    if (-1 == fd) {
+        log_perror(srv->errh, __FILE__, __LINE__, "socket");
+        return -1;
+    }
+    /* (replaces socket of previous generation, if any; previous generation
+     *  has already handed over its listen sockets in network_init()) */
+    unlink(un.sun_path);
+    if (0 != bind(fd, (struct sockaddr *)&un, sizeof(un))
+        || 0 != chmod(un.sun_path, S_IRUSR|S_IWUSR)
+        || 0 != listen(fd, 4)) {
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "server.upgrade-socket %s", un.sun_path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void network_upgrade_handover(server *srv, int fd) {
+    for (;;) {
+        sock_addr addr;
+        size_t addr_len = sizeof(addr);
+        const int cfd =
+          fdevent_accept_listenfd(fd, (struct sockaddr *)&addr, &addr_len);
+        if (-1 == cfd) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                log_perror(srv->errh, __FILE__, __LINE__,
+                  "server.upgrade-socket accept()");
+            return;
+        }
+
+      #ifdef SO_PEERCRED
+        struct ucred cred;
+        socklen_t clen = sizeof(cred);
+        if (0 != getsockopt(cfd, SOL_SOCKET, SO_PEERCRED, &cred, &clen)
+            || (0 != cred.uid && geteuid() != cred.uid)) {
+            log_error(srv->errh, __FILE__, __LINE__,
+              "server.upgrade-socket: rejected connection from uid %d",
+              (int)cred.uid);
+            close(cfd);
+            continue;
+        }
+      #endif
+
+        /* (blocking; small number of small messages to local peer) */
+        fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) & ~O_NONBLOCK);
+
+        uint32_t nfds = 0;
+        for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
+            if (-1 != srv->srv_sockets.ptr[i]->fd) ++nfds;
+        }
+
+        network_upgrade_msg hdr;
+        hdr.magic = NETWORK_UPGRADE_MAGIC;
+        hdr.version = NETWORK_UPGRADE_VERSION;
+        hdr.pid = (int32_t)srv->pid;
+        hdr.nfds = nfds;
+        union {
+            struct cmsghdr cm;
+            char buf[CMSG_SPACE(sizeof(int) * NETWORK_UPGRADE_BATCH)];
+        } ctl;
+        uint32_t i = 0, sent = 0;
+        do {
+            int fds[NETWORK_UPGRADE_BATCH];
+            int n = 0;
+            for (; i < srv->srv_sockets.used && n < NETWORK_UPGRADE_BATCH; ++i){
+                if (-1 != srv->srv_sockets.ptr[i]->fd)
+                    fds[n++] = srv->srv_sockets.ptr[i]->fd;
+            }
+            hdr.n = (uint32_t)n;
+
+            struct iovec iov = { &hdr, sizeof(hdr) };
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            if (n) {
+                memset(ctl.buf, 0, sizeof(ctl.buf));
+                msg.msg_control = ctl.buf;
+                msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+                struct cmsghdr * const cm = CMSG_FIRSTHDR(&msg);
+                cm->cmsg_level = SOL_SOCKET;
+                cm->cmsg_type = SCM_RIGHTS;
+                cm->cmsg_len = CMSG_LEN(sizeof(int) * n);
+                memcpy(CMSG_DATA(cm), fds, sizeof(int) * n);
+            }
+            ssize_t wr;
+            do { wr = sendmsg(cfd, &msg, 0); } while (-1 == wr && errno==EINTR);
+            if (wr != (ssize_t)sizeof(hdr)) {
+                log_perror(srv->errh, __FILE__, __LINE__,
+                  "server.upgrade-socket sendmsg()");
+                break;
+            }
+            sent += (uint32_t)n;
+        } while (sent < nfds);
+        close(cfd);
+
+        if (sent == nfds)
+            log_error(srv->errh, __FILE__, __LINE__,
+              "[note] handed over %u listen sockets", nfds);
+    }
+}
+
+#else
+
+int network_upgrade_listen(server *srv) {
+    log_error(srv->errh, __FILE__, __LINE__,
+      "server.upgrade-socket not supported on this platform");
+    return -1;
+}
+
+void network_upgrade_handover(server *srv, int fd) {
+    UNUSED(srv);
+    UNUSED(fd);
+}
+
+#endif
+
+#ifdef SO_BUSY_POLL
+static void network_busy_poll(server *srv) {
+	/* server.busy-poll: busy poll device queue on socket read (SO_BUSY_POLL)
+	 * set on listen sockets and inherited by accepted sockets;
+	 * (values larger than sysctl net.core.busy_read require CAP_NET_ADMIN,
+	 *  so set here, prior to dropping privileges) */
+	const int v = (int)srv->srvconf.busy_poll;
+	for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
+		const server_socket * const srv_socket = srv->srv_sockets.ptr[i];
+		if (AF_UNIX == sock_addr_get_family(&srv_socket->addr)) continue;
+		if (-1 == setsockopt(srv_socket->fd, SOL_SOCKET, SO_BUSY_POLL,
+		                     &v, sizeof(v))) {
+			log_perror(srv->errh, __FILE__, __LINE__,
+			  "setsockopt(SO_BUSY_POLL) %s", srv_socket->srv_token->ptr);
+			break;
+		}
+	}
+}
+#endif
+
+#ifdef TCP_NOTSENT_LOWAT
+static void network_notsent_lowat(server *srv) {
+	/* server.tcp-notsent-lowat: set on listen sockets and inherited by
+	 * accepted sockets; limits unsent data queued in kernel and delays
+	 * POLLOUT until unsent data is below threshold */
+	const int v = (int)srv->srvconf.tcp_notsent_lowat;
+	for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
+		const server_socket * const srv_socket = srv->srv_sockets.ptr[i];
+		if (AF_UNIX == sock_addr_get_family(&srv_socket->addr)) continue;
+		if (-1 == setsockopt(srv_socket->fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+		                     &v, sizeof(v))) {
+			log_perror(srv->errh, __FILE__, __LINE__,
+			  "setsockopt(TCP_NOTSENT_LOWAT) %s", srv_socket->srv_token->ptr);
+			srv->srvconf.tcp_notsent_lowat = 0;
+			break;
+		}
+	}
+}
+#endif
+
 int network_init(server *srv, int stdin_fd) {
     /*(network params used during setup (from $SERVER["socket"] condition))*/
     static const config_plugin_keys_t cpk[] = {
@@ -566,6 +1013,9 @@ int network_init(server *srv, int stdin_fd) {
      ,{ CONST_STR_LEN("server.v4mapped"),
         T_CONFIG_BOOL,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("server.reuseport"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
     #if 0 /* TODO: more integration needed ... */
      ,{ CONST_STR_LEN("mbedtls.engine"),
         T_CONFIG_BOOL,
@@ -610,6 +1060,20 @@ int network_init(server *srv, int stdin_fd) {
     int rc = 0;
     do {
 
+      #if defined(HAVE_SYS_UN_H) && defined(SCM_RIGHTS)
+        /* server.upgrade-socket: receive listen sockets from running server
+         * (previous generation) at startup (not upon graceful restart) */
+        if (srv->srvconf.upgrade_socket && -1 == stdin_fd
+            && 0 == srv->srv_sockets.used
+            && 0 == srv->srv_sockets_inherited.used
+            && !srv->sockets_disabled && !srv->srvconf.preflight_check) {
+            rc = network_upgrade_receive(srv);
+            if (rc < 0) break;
+            if (rc > 0) srv->srvconf.systemd_socket_activation = 1;
+            rc = 0;
+        }
+      #endif
+
         if (srv->srvconf.systemd_socket_activation) {
             for (uint32_t i = 0; i < srv->srv_sockets_inherited.used; ++i) {
                 srv->srv_sockets_inherited.ptr[i]->sidx = (unsigned short)~0u;
@@ -633,11 +1097,17 @@ int network_init(server *srv, int stdin_fd) {
                 buffer_append_int(b, srv->srvconf.port);
             }
 
+            const uint32_t used = srv->srv_sockets.used;
             rc = (-1 == stdin_fd || 0 == srv->srv_sockets.used)
               ? network_server_init(srv, &p->defaults, b, 0, stdin_fd)
               : close(stdin_fd);/*(graceful restart listening to "/dev/stdin")*/
             buffer_free(b);
             if (0 != rc) break;
+          #ifdef SO_REUSEPORT
+            if (-1 == stdin_fd && used != srv->srv_sockets.used)
+                network_server_init_reuseport(srv, &p->defaults,
+                                              srv->srv_sockets.ptr[used]);
+          #endif
         }
 
         /* check for $SERVER["socket"] */
@@ -660,8 +1130,14 @@ int network_init(server *srv, int stdin_fd) {
             }
 
             if (cfginfo.cond == CONFIG_COND_EQ) {
+                const uint32_t used = srv->srv_sockets.used;
                 rc = network_server_init(srv, &p->conf, host_token, i, -1);
                 if (0 != rc) break;
+              #ifdef SO_REUSEPORT
+                if (used != srv->srv_sockets.used)
+                    network_server_init_reuseport(srv, &p->conf,
+                                                  srv->srv_sockets.ptr[used]);
+              #endif
             }
             else if (cfginfo.cond == CONFIG_COND_NE) {
                 socklen_t addr_len = sizeof(sock_addr);
@@ -692,10 +1168,123 @@ int network_init(server *srv, int stdin_fd) {
 
     } while (0);
 
+  #ifdef SO_BUSY_POLL
+    if (0 == rc && srv->srvconf.busy_poll)
+        network_busy_poll(srv);
+  #endif
+  #ifdef TCP_NOTSENT_LOWAT
+    if (0 == rc && srv->srvconf.tcp_notsent_lowat)
+        network_notsent_lowat(srv);
+  #else
+    srv->srvconf.tcp_notsent_lowat = 0;
+  #endif
+
     free(p->cvlist);
     return rc;
 }
 
+static int network_reuseport_group(const server *srv, uint32_t i, int *cnt) {
+	/* index of srv_socket i in group of listen sockets bound to same addr
+	 * (SO_REUSEPORT group) and number of sockets in the group */
+	const sock_addr * const addr = &srv->srv_sockets.ptr[i]->addr;
+	int j = 0;
+	*cnt = 0;
+	for (uint32_t k = 0; k < srv->srv_sockets.used; ++k) {
+		if (0 != memcmp(&srv->srv_sockets.ptr[k]->addr, addr, sizeof(sock_addr)))
+			continue;
+		if (k < i) ++j;
+		++*cnt;
+	}
+	return j;
+}
+
+void network_reuseport_worker(server *srv, int worker, int nworkers, int cpu) {
+	/* keep only the listen sockets assigned to this worker
+	 * (listen sockets bound to the same addr are a SO_REUSEPORT group;
+	 *  each socket in a group is assigned to exactly one worker, or,
+	 *  if there are fewer sockets than workers, workers share sockets) */
+	if (srv->sockets_disabled) return; /* lighttpd -1 (one-shot mode) */
+	uint32_t used = 0;
+	for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
+		server_socket * const srv_socket = srv->srv_sockets.ptr[i];
+		int cnt;
+		const int j = network_reuseport_group(srv, i, &cnt);
+		if (cnt >= nworkers ? j % nworkers == worker : j == worker % cnt) {
+		  #ifdef SO_INCOMING_CPU
+			/* prefer socket of worker pinned to CPU receiving connection
+			 * (server.cpu-affinity); (socket not shared with other workers) */
+			if (cpu >= 0 && cnt >= nworkers && nworkers > 1
+			    && 0 != setsockopt(srv_socket->fd, SOL_SOCKET,
+			                       SO_INCOMING_CPU, &cpu, sizeof(cpu)))
+				log_perror(srv->errh, __FILE__, __LINE__,
+				  "setsockopt(SO_INCOMING_CPU)");
+		  #else
+			UNUSED(cpu);
+		  #endif
+			continue;
+		}
+		close(srv_socket->fd);
+		srv_socket->fd = -1;
+	}
+	for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
+		server_socket * const srv_socket = srv->srv_sockets.ptr[i];
+		if (-1 != srv_socket->fd) {
+			srv->srv_sockets.ptr[used++] = srv_socket;
+			continue;
+		}
+		buffer_free(srv_socket->srv_token);
+		free(srv_socket);
+	}
+	srv->srv_sockets.used = used;
+}
+
+void network_reuseport_bpf(server *srv, const int *cpu_worker, int ncpu, int nworkers) {
+	/* server.reuseport-bpf: steer new connection to the listen socket
+	 * of the worker pinned to the CPU on which the connection arrived
+	 * (cpu_worker[] maps CPU to worker; see server.cpu-affinity).
+	 * Sockets are added to a SO_REUSEPORT group in the order created, and
+	 * socket j of a group of nworkers sockets is kept by worker j, so the
+	 * program returns the worker index.  Unmapped CPUs use cpu % nworkers.
+	 * (Groups of other sizes, e.g. if some reuseport sockets could not be
+	 *  created, are left to the kernel default hash distribution) */
+  #if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	struct sock_filter code[BPF_MAXINSNS];
+	int n = 0;
+	code[n++] = (struct sock_filter)
+	  BPF_STMT(BPF_LD|BPF_W|BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU));
+	for (int c = 0; c < ncpu && n < BPF_MAXINSNS - 4; ++c) {
+		if (cpu_worker[c] < 0) continue;
+		code[n++] = (struct sock_filter)
+		  BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, (uint32_t)c, 0, 1);
+		code[n++] = (struct sock_filter)
+		  BPF_STMT(BPF_RET|BPF_K, (uint32_t)cpu_worker[c]);
+	}
+	code[n++] = (struct sock_filter)
+	  BPF_STMT(BPF_ALU|BPF_MOD|BPF_K, (uint32_t)nworkers);
+	code[n++] = (struct sock_filter)
+	  BPF_STMT(BPF_RET|BPF_A, 0);
+	struct sock_fprog prog = { (unsigned short)n, code };
+
+	for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
+		server_socket * const srv_socket = srv->srv_sockets.ptr[i];
+		int cnt;
+		if (0 != network_reuseport_group(srv, i, &cnt) || cnt != nworkers)
+			continue;
+		if (0 != setsockopt(srv_socket->fd, SOL_SOCKET,
+		                    SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)))
+			log_perror(srv->errh, __FILE__, __LINE__,
+			  "setsockopt(SO_ATTACH_REUSEPORT_CBPF) %s",
+			  srv_socket->srv_token->ptr);
+	}
+  #else
+	UNUSED(cpu_worker);
+	UNUSED(ncpu);
+	UNUSED(nworkers);
+	log_error(srv->errh, __FILE__, __LINE__,
+	  "server.reuseport-bpf not supported on this platform; ignored");
+  #endif
+}
+
 void network_unregister_sock(server *srv, server_socket *srv_socket) {
 	fdnode *fdn = srv_socket->fdn;
 	if (NULL == fdn) return;
@@ -711,12 +1300,18 @@ int network_register_fdevents(server *srv) {
 
 	if (srv->sockets_disabled) return 0; /* lighttpd -1 (one-shot mode) */
 
+	/* wake only one of the workers sharing listen sockets (if supported) */
+	srv->sockets_events = FDEVENT_IN;
+	if (srv->srvconf.max_worker > 1
+	    && (fdevent_features(srv->ev) & FDEVENT_EXCLUSIVE))
+		srv->sockets_events |= FDEVENT_EXCLUSIVE;
+
 	/* register fdevents after reset */
 	for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
 		server_socket *srv_socket = srv->srv_sockets.ptr[i];
 
 		srv_socket->fdn = fdevent_register(srv->ev, srv_socket->fd, network_server_handle_fdevent, srv_socket);
-		fdevent_fdnode_event_set(srv->ev, srv_socket->fdn, FDEVENT_IN);
+		fdevent_fdnode_event_set(srv->ev, srv_socket->fdn, srv->sockets_events);
 	}
 	return 0;
 }
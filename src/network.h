@@ -17,10 +17,22 @@ int network_close(server *srv);
 __attribute_cold__
 int network_register_fdevents(server *srv);
 
+__attribute_cold__
+void network_reuseport_worker(server *srv, int worker, int nworkers, int cpu);
+
+__attribute_cold__
+void network_reuseport_bpf(server *srv, const int *cpu_worker, int ncpu, int nworkers);
+
 __attribute_cold__
 void network_unregister_sock(server *srv, struct server_socket *srv_socket);
 
 __attribute_cold__
 void network_socket_activation_to_env (server *srv);
 
+__attribute_cold__
+int network_upgrade_listen(server *srv);
+
+__attribute_cold__
+void network_upgrade_handover(server *srv, int fd);
+
 #endif
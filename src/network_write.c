@@ -4,13 +4,18 @@
 
 #include "base.h"
 #include "log.h"
+#include "status_counter.h"
 
 #include <sys/types.h>
 #include "sys-socket.h"
 
 #include <errno.h>
+#include <fcntl.h>      /* posix_fadvise() */
 #include <string.h>
 #include <unistd.h>
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>    /* preadv2() RWF_NOWAIT */
+#endif
 
 
 /* on linux 2.4.x you get either sendfile or LFS */
@@ -66,6 +71,24 @@
 # define NETWORK_WRITE_USE_MMAP
 #endif
 
+#if defined(NETWORK_WRITE_USE_LINUX_SENDFILE) && defined(MSG_MORE) \
+ && defined(NETWORK_WRITE_USE_WRITEV)
+# define NETWORK_WRITE_USE_MSG_MORE
+#endif
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) \
+ && defined(NETWORK_WRITE_USE_WRITEV)
+# define NETWORK_WRITE_USE_ZEROCOPY
+#endif
+
+#if defined HAVE_POSIX_FADVISE && defined POSIX_FADV_WILLNEED
+# define NETWORK_WRITE_USE_FADVISE
+#endif
+
+#if defined HAVE_SYS_UIO_H && defined RWF_NOWAIT
+# define NETWORK_WRITE_USE_RWF_NOWAIT
+#endif
+
 
 static int network_write_error(int fd, log_error_st *errh) {
   #if defined(__WIN32)
@@ -138,6 +161,69 @@ static int network_write_mem_chunk(int fd, chunkqueue *cq, off_t *p_max_bytes, l
 
 
 
+#if defined(NETWORK_WRITE_USE_FADVISE)
+
+/* probe/advise file data in windows of this size ahead of send offset */
+#define NETWORK_WRITE_READAHEAD (512*1024)
+/* skip small files; blocking read of a few pages is cheaper than probing */
+#define NETWORK_WRITE_READAHEAD_MIN (64*1024)
+
+#if defined(NETWORK_WRITE_USE_RWF_NOWAIT)
+static int network_write_file_resident(const int fd, const off_t off) {
+    /* (returns 1 if page at off is in page cache or if unknown) */
+    char b;
+    struct iovec iov = { &b, 1 };
+    return (preadv2(fd, &iov, 1, off, RWF_NOWAIT) >= 0 || errno != EAGAIN);
+}
+#endif
+
+static void network_write_file_chunk_readahead(chunk * const c, off_t toSend) {
+    /* Probe whether file data about to be sent is in page cache and, if not,
+     * ask the kernel to start reading it asynchronously, so that sendfile(),
+     * mmap() access, or read() is less likely to block the event loop.
+     * Range already probed (here or by aio_prefetch) is in c->file.ra_end */
+    off_t off = c->offset;
+    off_t end = off + toSend;
+    if (end <= c->file.ra_end) return;
+    if (0 == c->file.ra_end) {
+        if (c->file.length - off < NETWORK_WRITE_READAHEAD_MIN) {
+            c->file.ra_end = c->file.length;
+            return;
+        }
+      #ifdef POSIX_FADV_SEQUENTIAL
+        /* large download; kernel doubles read ahead for file */
+        (void)posix_fadvise(c->file.fd, off, c->file.length - off,
+                            POSIX_FADV_SEQUENTIAL);
+      #endif
+    }
+    if (off < c->file.ra_end) off = c->file.ra_end;
+    if (end < off + NETWORK_WRITE_READAHEAD) end = off+NETWORK_WRITE_READAHEAD;
+    if (end > c->file.length) end = c->file.length;
+    c->file.ra_end = end;
+
+  #if defined(NETWORK_WRITE_USE_RWF_NOWAIT)
+    if (network_write_file_resident(c->file.fd, off)
+        && network_write_file_resident(c->file.fd, end-1)) {
+        status_counter_inc(CONST_STR_LEN("network.pagecache.hits"));
+        return;
+    }
+    status_counter_inc(CONST_STR_LEN("network.pagecache.misses"));
+  #endif
+
+    /* (also read ahead next window, so that it is resident when probed) */
+    (void)posix_fadvise(c->file.fd, off, end - off + NETWORK_WRITE_READAHEAD,
+                        POSIX_FADV_WILLNEED);
+}
+
+#else
+
+#define network_write_file_chunk_readahead(c, toSend) do { } while (0)
+
+#endif
+
+
+
+
 #if !defined(NETWORK_WRITE_USE_MMAP)
 
 static int network_write_file_chunk_no_mmap(int fd, chunkqueue *cq, off_t *p_max_bytes, log_error_st *errh) {
@@ -158,6 +244,7 @@ static int network_write_file_chunk_no_mmap(int fd, chunkqueue *cq, off_t *p_max
     }
 
     if (c->file.fd < 0 && 0 != chunkqueue_open_file_chunk(cq, errh)) return -1;
+    network_write_file_chunk_readahead(c, toSend);
 
     if (toSend > (off_t)sizeof(buf)) toSend = (off_t)sizeof(buf);
 
@@ -188,6 +275,7 @@ static int network_write_file_chunk_no_mmap(int fd, chunkqueue *cq, off_t *p_max
 #if defined(NETWORK_WRITE_USE_MMAP)
 
 #include "sys-mmap.h"
+#include "stat_cache.h" /* stat_cache_entry_mmap() */
 
 #include <setjmp.h>
 #include <signal.h>
@@ -234,11 +322,21 @@ static int network_write_file_chunk_mmap(int fd, chunkqueue *cq, off_t *p_max_by
     }
 
     if (c->file.fd < 0 && 0 != chunkqueue_open_file_chunk(cq, errh)) return -1;
+    network_write_file_chunk_readahead(c, toSend);
+
+    /* use mapping of entire file shared via stat_cache, if available */
+    stat_cache_entry * const sce = (c->file.refchg == stat_cache_entry_refchg)
+      ? c->file.ref
+      : NULL;
+    const char *shared = sce ? stat_cache_entry_mmap(sce) : NULL;
+    if (NULL != shared && file_end > (off_t)sce->mmap_length)
+        shared = NULL; /*(should not happen)*/
 
     /* mmap buffer if offset is outside old mmap area or not mapped at all */
-    if (MAP_FAILED == c->file.mmap.start
-        || offset < c->file.mmap.offset
-        || offset >= (off_t)(c->file.mmap.offset + c->file.mmap.length)) {
+    if (NULL == shared
+        && (MAP_FAILED == c->file.mmap.start
+            || offset < c->file.mmap.offset
+            || offset >= (off_t)(c->file.mmap.offset+c->file.mmap.length))) {
 
         if (MAP_FAILED != c->file.mmap.start) {
             munmap(c->file.mmap.start, c->file.mmap.length);
@@ -296,13 +394,18 @@ static int network_write_file_chunk_mmap(int fd, chunkqueue *cq, off_t *p_max_by
       #endif
     }
 
-    force_assert(offset >= c->file.mmap.offset);
-    mmap_offset = offset - c->file.mmap.offset;
-    force_assert(c->file.mmap.length > mmap_offset);
-    mmap_avail = c->file.mmap.length - mmap_offset;
-    if (toSend > (off_t) mmap_avail) toSend = mmap_avail;
-
-    data = c->file.mmap.start + mmap_offset;
+    if (shared) {
+        data = shared + offset;
+    }
+    else {
+        force_assert(offset >= c->file.mmap.offset);
+        mmap_offset = offset - c->file.mmap.offset;
+        force_assert(c->file.mmap.length > mmap_offset);
+        mmap_avail = c->file.mmap.length - mmap_offset;
+        if (toSend > (off_t) mmap_avail) toSend = mmap_avail;
+
+        data = c->file.mmap.start + mmap_offset;
+    }
 
     /* setup SIGBUS handler, but don't activate sigbus_jmp_valid yet */
     if (0 == sigsetjmp(sigbus_jmp, 1)) {
@@ -317,6 +420,10 @@ static int network_write_file_chunk_mmap(int fd, chunkqueue *cq, off_t *p_max_by
         log_error(errh, __FILE__, __LINE__,
           "SIGBUS in mmap: %s %d", c->mem->ptr, c->file.fd);
 
+        if (shared) {
+            stat_cache_entry_munmap(sce); /*(file changed; drop mapping)*/
+            return -1;
+        }
         munmap(c->file.mmap.start, c->file.mmap.length);
         c->file.mmap.start = MAP_FAILED;
         return -1;
@@ -372,8 +479,9 @@ static int network_writev_mem_chunks(int fd, chunkqueue *cq, off_t *p_max_bytes,
     off_t max_bytes = *p_max_bytes;
     off_t toSend = 0;
     ssize_t wr;
+    const chunk *c;
 
-    for (const chunk *c = cq->first;
+    for (c = cq->first;
          NULL != c && MEM_CHUNK == c->type
            && num_chunks < MAX_CHUNKS && toSend < max_bytes;
          c = c->next) {
@@ -395,6 +503,24 @@ static int network_writev_mem_chunks(int fd, chunkqueue *cq, off_t *p_max_bytes,
         return 0;
     }
 
+  #ifdef NETWORK_WRITE_USE_MSG_MORE
+    /* (e.g. response headers followed by FILE_CHUNK)
+     * hint to kernel that more data follows so that MEM_CHUNK data is
+     * coalesced with start of file data sent next by sendfile(), instead
+     * of being pushed out in a short segment of its own.  sendfile() sends
+     * the last of the requested range without MSG_MORE, so this replaces
+     * TCP_CORK around network_write() (see connection_write_chunkqueue()) */
+    if (NULL != c && FILE_CHUNK == c->type && toSend < max_bytes) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = chunks;
+        msg.msg_iovlen = num_chunks;
+        wr = sendmsg(fd, &msg, MSG_MORE);
+        if (wr < 0 && errno == ENOTSOCK)
+            wr = writev(fd, chunks, num_chunks);
+    }
+    else
+  #endif
     wr = writev(fd, chunks, num_chunks);
 
     if (wr < 0) switch (errno) {
@@ -419,6 +545,259 @@ static int network_writev_mem_chunks(int fd, chunkqueue *cq, off_t *p_max_bytes,
 
 #endif /* NETWORK_WRITE_USE_WRITEV */
 
+#if defined(NETWORK_WRITE_USE_ZEROCOPY)
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <linux/errqueue.h>
+
+/* MSG_ZEROCOPY: send large MEM_CHUNK without copying into kernel.
+ * Chunk buffer must not be modified or reused until kernel notifies
+ * completion of the send (on socket error queue).  The buffer is pinned:
+ * held by chunk while chunk is in write queue, and held here (instead of
+ * returning to chunk_buffer_release() pool) after chunk is released */
+
+typedef struct network_zc_pin {
+    struct network_zc_pin *next;
+    chunk *c;       /* chunk holding buffer (NULL once chunk released) */
+    buffer *b;      /* buffer held after chunk released */
+    uint32_t id;    /* notification id of last zero-copy send from buffer */
+} network_zc_pin;
+
+typedef struct {
+    network_zc_pin *pins;   /* ordered by id */
+    network_zc_pin *last;
+    uint32_t id;            /* notification id of next zero-copy send */
+    int state;              /* 0 n/a, 1 eligible, 2 SO_ZEROCOPY, -1 disabled */
+} network_zc_sock;
+
+/* socket closed by connection before all zero-copy sends completed */
+typedef struct network_zc_orphan {
+    struct network_zc_orphan *next;
+    network_zc_sock zs;
+    int fd;
+} network_zc_orphan;
+
+static off_t network_zc_threshold;
+static network_zc_sock *network_zc_socks;
+static uint32_t network_zc_socks_sz;
+static network_zc_orphan *network_zc_orphans;
+static server *network_zc_srv;
+
+static void network_zc_pin_release(void *ref, buffer *b) {
+    /* chunk released; hold buffer until kernel completes zero-copy send */
+    network_zc_pin * const pin = ref;
+    pin->c = NULL;
+    pin->b = b;
+}
+
+static void network_zc_pin_free(network_zc_pin * const pin) {
+    if (pin->c) { /* chunk still in write queue; buffer no longer pinned */
+        pin->c->pin.release = 0; /* NULL fn ptr */
+        pin->c->pin.ref = NULL;
+    }
+    else
+        chunk_buffer_release(pin->b);
+    free(pin);
+}
+
+static void network_zc_complete(network_zc_sock * const zs, const uint32_t lo, const uint32_t hi, const int copied) {
+    /* completed notification ids in range [lo, hi] (in order for TCP) */
+    int * const ctr = copied
+      ? status_counter_get_counter(CONST_STR_LEN("network.zerocopy.copied"))
+      : status_counter_get_counter(CONST_STR_LEN("network.zerocopy.hits"));
+    *ctr += (int)(hi - lo + 1);
+    /* kernel fell back to copying (e.g. loopback or device without
+     * scatter-gather): stop using MSG_ZEROCOPY on socket (pure overhead) */
+    if (copied) zs->state = -1;
+
+    for (network_zc_pin *pin; (pin = zs->pins); ) {
+        if ((int32_t)(pin->id - hi) > 0) break;
+        if (NULL == (zs->pins = pin->next)) zs->last = NULL;
+        network_zc_pin_free(pin);
+    }
+}
+
+static int network_zc_reap(const int fd, network_zc_sock * const zs) {
+    /* drain MSG_ZEROCOPY completion notifications from socket error queue */
+    union {
+        struct cmsghdr cm;
+        char buf[CMSG_SPACE(sizeof(struct sock_extended_err)
+                            + sizeof(struct sockaddr_in6))];
+    } ctl;
+    int n = 0;
+    for (;;) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = sizeof(ctl.buf);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) break; /*(EAGAIN: drained)*/
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+             cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                  || (cm->cmsg_level == SOL_IPV6
+                      && cm->cmsg_type == IPV6_RECVERR))) continue;
+            struct sock_extended_err ee;
+            memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+            if (ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY || 0 != ee.ee_errno)
+                continue;
+            network_zc_complete(zs, ee.ee_info, ee.ee_data,
+                                (ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED));
+            ++n;
+        }
+    }
+    return n;
+}
+
+void network_write_zerocopy_accept(const int fd) {
+    if (!network_zc_threshold || fd < 0) return;
+    if ((uint32_t)fd >= network_zc_socks_sz) {
+        const uint32_t sz = ((uint32_t)fd + 1024) & ~1023u;
+        network_zc_socks =
+          realloc(network_zc_socks, sz * sizeof(*network_zc_socks));
+        force_assert(NULL != network_zc_socks);
+        memset(network_zc_socks + network_zc_socks_sz, 0,
+               (sz - network_zc_socks_sz) * sizeof(*network_zc_socks));
+        network_zc_socks_sz = sz;
+    }
+    network_zc_socks[fd].state = 1; /* SO_ZEROCOPY set upon first use */
+}
+
+int network_write_zerocopy_close(const int fd) {
+    if ((uint32_t)fd >= network_zc_socks_sz) return 0;
+    network_zc_sock * const zs = network_zc_socks + fd;
+    if (zs->pins) network_zc_reap(fd, zs);
+    if (NULL == zs->pins) {
+        memset(zs, 0, sizeof(*zs));
+        return 0;
+    }
+
+    /* The kernel may continue to send from pinned buffers after close()
+     * (e.g. TCP retransmits), but completions can be received only while
+     * the socket is open.  Shut down the socket instead of closing it, and
+     * keep fd and pinned buffers until all sends complete (the kernel
+     * eventually completes sends, even if the connection fails) */
+    shutdown(fd, SHUT_RDWR);
+    network_zc_orphan * const o = malloc(sizeof(*o));
+    force_assert(NULL != o);
+    o->zs = *zs;
+    o->fd = fd;
+    o->next = network_zc_orphans;
+    network_zc_orphans = o;
+    memset(zs, 0, sizeof(*zs));
+    return 1;
+}
+
+void network_write_zerocopy_maint(void) {
+    for (network_zc_orphan **pp = &network_zc_orphans, *o; (o = *pp); ) {
+        network_zc_reap(o->fd, &o->zs);
+        if (o->zs.pins) { pp = &o->next; continue; }
+        if (0 == close(o->fd))
+            --network_zc_srv->cur_fds;
+        *pp = o->next;
+        free(o);
+    }
+}
+
+int network_write_zerocopy_notify(const int fd) {
+    /* check if FDEVENT_ERR is due only to MSG_ZEROCOPY notifications */
+    if ((uint32_t)fd >= network_zc_socks_sz) return 0;
+    network_zc_sock * const zs = network_zc_socks + fd;
+    if (0 == zs->id || 0 == network_zc_reap(fd, zs)) return 0;
+    struct pollfd pfd = { fd, 0, 0 };
+    return (0 == poll(&pfd, 1, 0)) || !(pfd.revents & POLLERR);
+}
+
+static int network_write_mem_chunk_zerocopy(int fd, chunkqueue *cq, off_t *p_max_bytes, log_error_st *errh, network_zc_sock *zs) {
+    chunk * const c = cq->first;
+    off_t c_len = (off_t)buffer_string_length(c->mem) - c->offset;
+    if (c_len > *p_max_bytes) c_len = *p_max_bytes;
+
+    ssize_t wr = send(fd, c->mem->ptr + c->offset, (size_t)c_len, MSG_ZEROCOPY);
+
+    if (wr < 0) switch (errno) {
+      case ENOBUFS: /* notifications exceed optmem limit; copy instead */
+        return network_writev_mem_chunks(fd, cq, p_max_bytes, errh);
+      case EAGAIN:
+      case EINTR:
+        return -3;
+      case EPIPE:
+      case ECONNRESET:
+        return -2;
+      default:
+        log_perror(errh, __FILE__, __LINE__, "send(MSG_ZEROCOPY) failed: %d", fd);
+        return -1;
+    }
+
+    /* pin buffer until kernel notifies completion of send */
+    network_zc_pin *pin = c->pin.ref;
+    if (NULL == pin) {
+        pin = malloc(sizeof(*pin));
+        force_assert(NULL != pin);
+        pin->next = NULL;
+        pin->c = c;
+        pin->b = NULL;
+        if (zs->last)
+            zs->last->next = pin;
+        else
+            zs->pins = pin;
+        zs->last = pin;
+        c->pin.ref = pin;
+        c->pin.release = network_zc_pin_release;
+    }
+    pin->id = zs->id++;
+    status_counter_inc(CONST_STR_LEN("network.zerocopy.sends"));
+
+    *p_max_bytes -= wr;
+    chunkqueue_mark_written(cq, wr);
+
+    return (wr == c_len) ? 0 : -3;
+}
+
+/* next chunk must be MEM_CHUNK; send with MSG_ZEROCOPY if large enough */
+static int network_write_mem_chunks_zerocopy(int fd, chunkqueue *cq, off_t *p_max_bytes, log_error_st *errh) {
+    if ((uint32_t)fd < network_zc_socks_sz) {
+        network_zc_sock * const zs = network_zc_socks + fd;
+        if (zs->pins) network_zc_reap(fd, zs);
+        const chunk * const c = cq->first;
+        if (zs->state > 0 && !c->ring /*(ring buffer memory is reused)*/
+            && (off_t)buffer_string_length(c->mem) - c->offset
+                 >= network_zc_threshold) {
+            if (1 == zs->state) {
+                const int v = 1;
+                zs->state = (0 == setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY,
+                                             &v, sizeof(v))) ? 2 : -1;
+            }
+            if (2 == zs->state)
+                return network_write_mem_chunk_zerocopy(fd, cq, p_max_bytes,
+                                                        errh, zs);
+        }
+    }
+    return network_writev_mem_chunks(fd, cq, p_max_bytes, errh);
+}
+
+#else
+
+void network_write_zerocopy_accept(const int fd) {
+    UNUSED(fd);
+}
+
+int network_write_zerocopy_close(const int fd) {
+    UNUSED(fd);
+    return 0;
+}
+
+void network_write_zerocopy_maint(void) {
+}
+
+int network_write_zerocopy_notify(const int fd) {
+    UNUSED(fd);
+    return 0;
+}
+
+#endif /* NETWORK_WRITE_USE_ZEROCOPY */
+
 
 
 
@@ -453,6 +832,7 @@ static int network_write_file_chunk_sendfile(int fd, chunkqueue *cq, off_t *p_ma
     }
 
     if (c->file.fd < 0 && 0 != chunkqueue_open_file_chunk(cq, errh)) return -1;
+    network_write_file_chunk_readahead(c, toSend);
 
     /* Darwin, FreeBSD, and Solaris variants support iovecs and could
      * be optimized to send more than just file in single syscall */
@@ -581,7 +961,11 @@ static int network_write_chunkqueue_writev(int fd, chunkqueue *cq, off_t max_byt
 
         switch (cq->first->type) {
         case MEM_CHUNK:
-          #if defined(NETWORK_WRITE_USE_WRITEV)
+          #if defined(NETWORK_WRITE_USE_ZEROCOPY)
+            rc = network_zc_threshold
+              ? network_write_mem_chunks_zerocopy(fd, cq, &max_bytes, errh)
+              : network_writev_mem_chunks(fd, cq, &max_bytes, errh);
+          #elif defined(NETWORK_WRITE_USE_WRITEV)
             rc = network_writev_mem_chunks(fd, cq, &max_bytes, errh);
           #else
             rc = network_write_mem_chunk(fd, cq, &max_bytes, errh);
@@ -611,7 +995,11 @@ static int network_write_chunkqueue_sendfile(int fd, chunkqueue *cq, off_t max_b
 
         switch (cq->first->type) {
         case MEM_CHUNK:
-          #if defined(NETWORK_WRITE_USE_WRITEV)
+          #if defined(NETWORK_WRITE_USE_ZEROCOPY)
+            rc = network_zc_threshold
+              ? network_write_mem_chunks_zerocopy(fd, cq, &max_bytes, errh)
+              : network_writev_mem_chunks(fd, cq, &max_bytes, errh);
+          #elif defined(NETWORK_WRITE_USE_WRITEV)
             rc = network_writev_mem_chunks(fd, cq, &max_bytes, errh);
           #else
             rc = network_write_mem_chunk(fd, cq, &max_bytes, errh);
@@ -679,10 +1067,20 @@ int network_write_init(server *srv) {
         }
     }
 
+  #if defined(NETWORK_WRITE_USE_ZEROCOPY)
+    network_zc_threshold = (off_t)srv->srvconf.zerocopy_threshold;
+    network_zc_srv = srv;
+  #endif
+
+    srv->network_backend_more = 0;
+
     switch(backend) {
     case NETWORK_BACKEND_SENDFILE:
       #if defined(NETWORK_WRITE_USE_SENDFILE)
         srv->network_backend_write = network_write_chunkqueue_sendfile;
+       #if defined(NETWORK_WRITE_USE_MSG_MORE)
+        srv->network_backend_more = 1;
+       #endif
         break;
       #endif
     case NETWORK_BACKEND_WRITEV:
@@ -733,6 +1131,11 @@ const char * network_write_show_handlers(void) {
       "\t+ mmap support\n"
      #else
       "\t- mmap support\n"
+     #endif
+     #ifdef NETWORK_WRITE_USE_ZEROCOPY
+      "\t+ MSG_ZEROCOPY support\n"
+     #else
+      "\t- MSG_ZEROCOPY support\n"
      #endif
       ;
 }
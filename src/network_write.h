@@ -9,4 +9,11 @@ int network_write_init(server *srv);
 __attribute_cold__
 const char * network_write_show_handlers(void);
 
+void network_write_zerocopy_accept(int fd);
+int network_write_zerocopy_close(int fd);
+void network_write_zerocopy_maint(void);
+
+__attribute_cold__
+int network_write_zerocopy_notify(int fd);
+
 #endif
@@ -8,6 +8,7 @@
 #include "reqpool.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "base.h"
 #include "buffer.h"
@@ -49,6 +50,124 @@ request_init_data (request_st * const r, connection * const con, server * const
 }
 
 
+/* per-request arena
+ *
+ * Bump allocator for objects which live until request_reset(), e.g. module
+ * handler contexts.  The first block is kept for the next request.  When a
+ * request overflows it, all blocks are released at reset and the next request
+ * allocates a single block sized for that peak (up to REQUEST_ARENA_BLOCK_MAX)
+ * so that steady-state request processing does not call malloc() here.
+ * Allocations larger than a quarter of the block size get a dedicated block.
+ */
+
+#define REQUEST_ARENA_BLOCK_MIN 4096
+#define REQUEST_ARENA_BLOCK_MAX (64*1024)
+#define REQUEST_ARENA_ALIGN     16
+
+struct request_arena_block {
+    struct request_arena_block *next;
+    uint32_t size;
+    uint32_t used;
+};
+
+#define REQUEST_ARENA_HDR_SZ \
+  ((sizeof(struct request_arena_block) + REQUEST_ARENA_ALIGN-1) \
+   & ~(size_t)(REQUEST_ARENA_ALIGN-1))
+
+
+__attribute_cold__
+__attribute_noinline__
+__attribute_returns_nonnull__
+static struct request_arena_block *
+request_arena_block_new (request_arena * const a, const size_t sz)
+{
+    size_t bsz = a->bsz ? a->bsz : REQUEST_ARENA_BLOCK_MIN;
+    const int dedicated = (sz > (bsz >> 2));
+    if (dedicated) bsz = sz;
+    struct request_arena_block * const blk = malloc(REQUEST_ARENA_HDR_SZ+bsz);
+    force_assert(blk);
+    blk->size = (uint32_t)bsz;
+    blk->used = 0;
+    if (dedicated && a->head) {
+        /* keep current head block for subsequent small allocations */
+        blk->next = a->head->next;
+        a->head->next = blk;
+    }
+    else {
+        blk->next = a->head;
+        a->head = blk;
+    }
+    return blk;
+}
+
+
+void *
+request_arena_alloc (request_st * const r, size_t sz)
+{
+    sz = (sz + REQUEST_ARENA_ALIGN-1) & ~(size_t)(REQUEST_ARENA_ALIGN-1);
+    force_assert(sz <= UINT32_MAX - REQUEST_ARENA_HDR_SZ);
+    struct request_arena_block *blk = r->arena.head;
+    if (NULL == blk || blk->size - blk->used < sz)
+        blk = request_arena_block_new(&r->arena, sz);
+    char * const ptr = (char *)blk + REQUEST_ARENA_HDR_SZ + blk->used;
+    blk->used += (uint32_t)sz;
+    return ptr;
+}
+
+
+void *
+request_arena_calloc (request_st * const r, const size_t sz)
+{
+    return memset(request_arena_alloc(r, sz), 0, sz);
+}
+
+
+char *
+request_arena_strdup (request_st * const r, const char * const s, const size_t len)
+{
+    char * const ptr = request_arena_alloc(r, len+1);
+    memcpy(ptr, s, len);
+    ptr[len] = '\0';
+    return ptr;
+}
+
+
+static void
+request_arena_reset (request_arena * const a)
+{
+    struct request_arena_block *blk = a->head;
+    if (NULL == blk) return;
+    if (NULL == blk->next && blk->size <= REQUEST_ARENA_BLOCK_MAX) {
+        blk->used = 0;
+        return;
+    }
+
+    /* request overflowed block; size next block to fit peak usage */
+    size_t total = 0;
+    do {
+        struct request_arena_block * const next = blk->next;
+        total += blk->used;
+        free(blk);
+        blk = next;
+    } while (blk);
+    a->head = NULL;
+    uint32_t bsz = a->bsz ? a->bsz : REQUEST_ARENA_BLOCK_MIN;
+    while (bsz < total && bsz < REQUEST_ARENA_BLOCK_MAX) bsz <<= 1;
+    a->bsz = bsz;
+}
+
+
+static void
+request_arena_free (request_arena * const a)
+{
+    for (struct request_arena_block *next, *blk = a->head; blk; blk = next) {
+        next = blk->next;
+        free(blk);
+    }
+    a->head = NULL;
+}
+
+
 void
 request_reset (request_st * const r)
 {
@@ -116,6 +235,39 @@ request_reset (request_st * const r)
 
     /* The cond_cache gets reset in response.c */
     /* config_cond_cache_reset(r); */
+
+    /*(after plugins_call_handle_request_reset(); modules free contexts)*/
+    request_arena_reset(&r->arena);
+}
+
+
+void
+request_reset_idle (request_st * const r)
+{
+    /* release memory retained by request_reset() for reuse while connection
+     * is idle in keep-alive; buffers and arrays are left in the same state
+     * as for a new connection and are reacquired on demand (buffer pool) by
+     * the next request on the connection
+     * (r->target_orig, r->uri.authority, r->uri.path, r->uri.query and
+     *  r->server_name_buf are kept; used by mod_status, as in request_reset())
+     */
+    array_free_data(&r->rqst_headers);
+    array_free_data(&r->resp_headers);
+    array_free_data(&r->env);
+
+    buffer_free_ptr(&r->target);
+
+    buffer_free_ptr(&r->uri.scheme);
+
+    buffer_free_ptr(&r->physical.doc_root);
+    buffer_free_ptr(&r->physical.path);
+    buffer_free_ptr(&r->physical.basedir);
+    buffer_free_ptr(&r->physical.etag);
+    buffer_free_ptr(&r->physical.rel_path);
+
+    buffer_free_ptr(&r->pathinfo);
+
+    request_arena_free(&r->arena);
 }
 
 
@@ -196,6 +348,8 @@ request_free_data (request_st * const r)
     free(r->cond_cache);
     free(r->cond_match);
 
+    request_arena_free(&r->arena);
+
     /* note: r is not zeroed here and r is not freed here */
 }
 
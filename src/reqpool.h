@@ -7,12 +7,24 @@
 void request_init_data (request_st *r, connection *con, server *srv);
 void request_reset (request_st *r);
 void request_reset_ex (request_st *r);
+void request_reset_idle (request_st *r);
 void request_release (request_st *r);
 request_st * request_acquire (connection *con);
 
 __attribute_cold__
 void request_free_data (request_st *r);
 
+/* request-lifetime allocations (bump allocator); released by request_reset()
+ * (memory must not be free()d; objects must not be referenced after reset) */
+__attribute_returns_nonnull__
+void * request_arena_alloc (request_st *r, size_t sz);
+
+__attribute_returns_nonnull__
+void * request_arena_calloc (request_st *r, size_t sz);
+
+__attribute_returns_nonnull__
+char * request_arena_strdup (request_st *r, const char *s, size_t len);
+
 __attribute_cold__
 void request_pool_init (uint32_t sz);
 
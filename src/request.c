@@ -19,6 +19,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define REQUEST_CTL_SSE2
+#include <emmintrin.h>
+#if defined(__x86_64__) && defined(__GNUC__) \
+ && (defined(__clang__) || __GNUC__ >= 5)
+#define REQUEST_CTL_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
 static int request_check_hostname(buffer * const host) {
 	enum { DOMAINLABEL, TOPLABEL } stage = TOPLABEL;
 	size_t i;
@@ -376,6 +386,90 @@ static int http_request_header_char_invalid(request_st * const restrict r, const
 }
 
 
+/* find first CTL (0-31 except HT) or DEL in header value
+ * (return vlen if none found)
+ * (header values such as Cookie and User-Agent are commonly long enough to
+ *  benefit from checking 16 or 32 bytes at a time) */
+
+__attribute_pure__
+static uint32_t http_request_header_value_ctl_scalar (const char * const v, const uint32_t vlen, uint32_t j) {
+    for (; j < vlen; ++j) {
+        if ((((uint8_t *)v)[j] < 32 && v[j] != '\t') || v[j] == 127)
+            break;
+    }
+    return j;
+}
+
+#ifdef REQUEST_CTL_SSE2
+
+__attribute_pure__
+static uint32_t http_request_header_value_ctl_sse2 (const char * const v, const uint32_t vlen) {
+    const __m128i ctl = _mm_set1_epi8(31);
+    const __m128i ht  = _mm_set1_epi8('\t');
+    const __m128i del = _mm_set1_epi8(127);
+    uint32_t j = 0;
+    for (; j + 16 <= vlen; j += 16) {
+        const __m128i x = _mm_loadu_si128((const __m128i *)(const void *)(v+j));
+        /*(x <= 31 unsigned: min(x,31) == x)*/
+        const __m128i m =
+          _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(x, ht),
+                                        _mm_cmpeq_epi8(_mm_min_epu8(x,ctl),x)),
+                       _mm_cmpeq_epi8(x, del));
+        const uint32_t bits = (uint32_t)_mm_movemask_epi8(m);
+        if (bits) return j + (uint32_t)__builtin_ctz(bits);
+    }
+    return http_request_header_value_ctl_scalar(v, vlen, j);
+}
+
+#ifdef REQUEST_CTL_AVX2
+
+__attribute_pure__
+__attribute__((__target__("avx2")))
+static uint32_t http_request_header_value_ctl_avx2 (const char * const v, const uint32_t vlen) {
+    const __m256i ctl = _mm256_set1_epi8(31);
+    const __m256i ht  = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(127);
+    uint32_t j = 0;
+    for (; j + 32 <= vlen; j += 32) {
+        const __m256i x =
+          _mm256_loadu_si256((const __m256i *)(const void *)(v+j));
+        const __m256i m =
+          _mm256_or_si256(
+            _mm256_andnot_si256(_mm256_cmpeq_epi8(x, ht),
+                                _mm256_cmpeq_epi8(_mm256_min_epu8(x,ctl),x)),
+            _mm256_cmpeq_epi8(x, del));
+        const uint32_t bits = (uint32_t)_mm256_movemask_epi8(m);
+        if (bits) return j + (uint32_t)__builtin_ctz(bits);
+    }
+    _mm256_zeroupper(); /*(avoid AVX-SSE transition penalty in callee)*/
+    return j + http_request_header_value_ctl_sse2(v+j, vlen-j);
+}
+
+static uint32_t http_request_header_value_ctl_init (const char *v, uint32_t vlen);
+static uint32_t (*http_request_header_value_ctl)(const char *, uint32_t) =
+  http_request_header_value_ctl_init;
+
+__attribute_cold__
+static uint32_t http_request_header_value_ctl_init (const char * const v, const uint32_t vlen) {
+    /* select implementation for this CPU upon first use */
+    __builtin_cpu_init();
+    http_request_header_value_ctl = __builtin_cpu_supports("avx2")
+      ? http_request_header_value_ctl_avx2
+      : http_request_header_value_ctl_sse2;
+    return http_request_header_value_ctl(v, vlen);
+}
+
+#else
+#define http_request_header_value_ctl(v, vlen) \
+        http_request_header_value_ctl_sse2((v), (vlen))
+#endif
+
+#else
+#define http_request_header_value_ctl(v, vlen) \
+        http_request_header_value_ctl_scalar((v), (vlen), 0)
+#endif
+
+
 static int64_t
 li_restricted_strtoint64 (const char *v, const uint32_t vlen, const char ** const err)
 {
@@ -795,11 +889,10 @@ http_request_parse_header (request_st * const restrict r, http_header_parse_ctx
             }
 
             if (http_header_strict) {
-                for (uint32_t j = 0; j < vlen; ++j) {
-                    if ((((uint8_t *)v)[j] < 32 && v[j] != '\t') || v[j]==127)
-                        return http_request_header_char_invalid(r, v[j],
-                          "invalid character in header -> 400");
-                }
+                const uint32_t j = http_request_header_value_ctl(v, vlen);
+                if (j != vlen)
+                    return http_request_header_char_invalid(r, v[j],
+                      "invalid character in header -> 400");
             }
             else {
                 if (NULL != memchr(v, '\0', vlen))
@@ -1189,10 +1282,9 @@ static int http_request_parse_headers(request_st * const restrict r, char * cons
         if (vlen <= 0) continue; /* ignore header */
 
         if (http_header_strict) {
-            for (int j = 0; j < vlen; ++j) {
-                if ((((unsigned char *)v)[j] < 32 && v[j] != '\t') || v[j]==127)
-                    return http_request_header_char_invalid(r, v[j], "invalid character in header -> 400");
-            }
+            const uint32_t j = http_request_header_value_ctl(v, (uint32_t)vlen);
+            if (j != (uint32_t)vlen)
+                return http_request_header_char_invalid(r, v[j], "invalid character in header -> 400");
         } /* else URI already checked in http_request_parse_reqline() for any '\0' */
 
         int status = http_request_parse_single_header(r, id, k, (size_t)klen, v, (size_t)vlen);
@@ -69,7 +69,7 @@ typedef struct {
      * we somehow have to lose our "we are writable" signal on the way.
      *
      */
-    off_t *global_bytes_per_second_cnt_ptr; /*  */
+    off_t *global_bytes_per_second_cnt_ptr; /* see connection_write_share() */
 
     const buffer *error_handler;
     const buffer *error_handler_404;
@@ -104,6 +104,13 @@ typedef struct {
     int done;
 } response_dechunk;
 
+struct request_arena_block;     /* (see reqpool.c) */
+
+typedef struct {
+    struct request_arena_block *head;
+    uint32_t bsz;               /* size of next block allocated */
+} request_arena;
+
 /* the order of the items should be the same as they are processed
  * read before write as we use this later e.g. <= CON_STATE_REQUEST_END */
 typedef enum {
@@ -178,7 +185,8 @@ struct request_st {
     char async_callback;
 
     buffer *tmp_buf;                    /* shared; same as srv->tmp_buf */
-    response_dechunk *gw_dechunk;
+    response_dechunk *gw_dechunk;       /* (request_arena_calloc()) */
+    request_arena arena;                /* request-lifetime allocations */
 
     off_t bytes_written_ckpt; /* used by mod_accesslog */
     off_t bytes_read_ckpt;    /* used by mod_accesslog */
@@ -13,9 +13,11 @@
 #include "connections.h"
 #include "sock_addr.h"
 #include "stat_cache.h"
+#include "aio_prefetch.h"   /* aio_prefetch_init() aio_prefetch_free() */
+#include "status_counter.h"
 #include "plugin.h"
 #include "plugin_config.h"  /* config_plugin_value_tobool() */
-#include "network_write.h"  /* network_write_show_handlers() */
+#include "network_write.h"  /* network_write_show_handlers() network_write_zerocopy_maint() */
 #include "reqpool.h"        /* request_pool_init() request_pool_free() */
 #include "response.h"       /* http_response_send_1xx_cb_set() strftime_cache_reset() */
 
@@ -73,6 +75,10 @@ static const buffer default_server_tag = { CONST_STR_LEN(PACKAGE_DESC)+1, 0 };
 # include <sys/prctl.h>
 #endif
 
+#ifdef HAVE_SCHED_SETAFFINITY
+# include <sched.h>
+#endif
+
 #include "sys-crypto.h"
 #if defined(USE_OPENSSL_CRYPTO) \
  || defined(USE_MBEDTLS_CRYPTO) \
@@ -102,7 +108,10 @@ static volatile sig_atomic_t srv_shutdown = 0;
 static volatile sig_atomic_t handle_sig_child = 0;
 static volatile sig_atomic_t handle_sig_alarm = 1;
 static volatile sig_atomic_t handle_sig_hup = 0;
+static volatile sig_atomic_t handle_sig_io = 0;
 static time_t idle_limit = 0;
+static int upgrade_fd = -1;
+static time_t prev_gen_ts = 0;
 
 #if defined(HAVE_SIGACTION) && defined(SA_SIGINFO)
 static volatile siginfo_t last_sigterm_info;
@@ -148,6 +157,11 @@ static void sigaction_handler(int sig, siginfo_t *si, void *context) {
 	case SIGCHLD:
 		handle_sig_child = 1;
 		break;
+#ifdef SIGIO
+	case SIGIO:
+		handle_sig_io = 1;
+		break;
+#endif
 	}
 }
 #elif defined(HAVE_SIGNAL) || defined(HAVE_SIGACTION)
@@ -173,6 +187,9 @@ static void signal_handler(int sig) {
 	case SIGALRM: handle_sig_alarm = 1; break;
 	case SIGHUP:  handle_sig_hup = 1; break;
 	case SIGCHLD: handle_sig_child = 1; break;
+#ifdef SIGIO
+	case SIGIO:   handle_sig_io = 1; break;
+#endif
 	}
 }
 #endif
@@ -285,6 +302,7 @@ static void server_free(server *srv) {
 
 #undef CLEAN
 
+	aio_prefetch_free();
 	fdevent_free(srv->ev);
 
 	config_free(srv);
@@ -300,6 +318,7 @@ static void server_free(server *srv) {
 
 	log_error_st_free(srv->errh);
 	free(srv);
+	buffer_pool_free();
 }
 
 __attribute_cold__
@@ -783,6 +802,17 @@ static void server_graceful_signal_prev_generation (void)
     kill(pid, SIGINT); /* signal previous generation for graceful shutdown */
 }
 
+__attribute_cold__
+static void server_graceful_signal_prev_generation_warmup (server *srv)
+{
+    /* server.upgrade-warmup: continue to let previous generation accept
+     * connections on shared listen sockets while this server warms up */
+    if (srv->srvconf.upgrade_warmup && getenv("LIGHTTPD_PREV_GEN"))
+        prev_gen_ts = time(NULL) + srv->srvconf.upgrade_warmup;
+    else
+        server_graceful_signal_prev_generation();
+}
+
 __attribute_cold__
 static int server_graceful_state_bg (server *srv) {
     /*assert(graceful_restart);*/
@@ -880,6 +910,18 @@ static int server_graceful_state_bg (server *srv) {
     }
     /* else child/grandchild */
 
+    /* (restarted server listens on server.upgrade-socket) */
+    if (-1 != upgrade_fd) {
+        close(upgrade_fd);
+        upgrade_fd = -1;
+    }
+
+    /* (aio_prefetch helper threads are not inherited across fork()) */
+    if (srv->srvconf.aio_threads) {
+        aio_prefetch_fork_child();
+        srv->srvconf.aio_threads = 0;
+    }
+
     /*if (-1 == setsid()) _exit(1);*//* should we detach? */
     /* Note: restarted server will fail with socket-in-use error if
      *       server.systemd-socket-activation not enabled in restarted server */
@@ -968,7 +1010,7 @@ static void server_graceful_state (server *srv) {
 
 __attribute_cold__
 static void server_sockets_enable (server *srv) {
-    server_sockets_set_event(srv, FDEVENT_IN);
+    server_sockets_set_event(srv, srv->sockets_events);
     srv->sockets_disabled = 0;
     log_error(srv->errh, __FILE__, __LINE__, "[note] sockets enabled again");
 }
@@ -1012,6 +1054,106 @@ static void server_process_fdwaitqueue (server *srv) {
     }
 }
 
+#ifdef HAVE_SCHED_SETAFFINITY
+
+__attribute_cold__
+static int server_cpuset_parse (cpu_set_t * const set, const char *s) {
+    /* parse CPU list, e.g. "0-3,8,10-11" */
+    CPU_ZERO(set);
+    do {
+        char *e;
+        if (!light_isdigit(*s)) return -1;
+        unsigned long lo = strtoul(s, &e, 10), hi = lo;
+        if (*e == '-') {
+            if (!light_isdigit(e[1])) return -1;
+            hi = strtoul(e+1, &e, 10);
+        }
+        if (hi < lo || hi >= CPU_SETSIZE) return -1;
+        do { CPU_SET(lo, set); } while (++lo <= hi);
+        s = e;
+    } while (*s == ',' && *++s);
+    return (*s == '\0') ? 0 : -1;
+}
+
+__attribute_cold__
+static int server_cpu_affinity_check (server * const srv) {
+    const array * const a = srv->srvconf.cpu_affinity;
+    if (NULL == a || 0 == a->used) return 0;
+    for (uint32_t i = 0; i < a->used; ++i) {
+        cpu_set_t set;
+        const data_string * const ds = (const data_string *)a->data[i];
+        if (0 != server_cpuset_parse(&set, ds->value.ptr)) {
+            log_error(srv->errh, __FILE__, __LINE__,
+              "invalid CPU list in server.cpu-affinity: \"%s\"",
+              ds->value.ptr);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+__attribute_cold__
+static int server_cpu_affinity_set (server * const srv, const int worker) {
+    /* server.cpu-affinity = ( "0-3", "4-7", ... )
+     * pin worker n to CPU set (n % number of CPU sets);
+     * memory allocated by worker after pinning is then usually local to the
+     * NUMA node of those CPUs.  Returns first CPU in set, or -1 */
+    const array * const a = srv->srvconf.cpu_affinity;
+    if (NULL == a || 0 == a->used) return -1;
+    const data_string * const ds =
+      (const data_string *)a->data[(uint32_t)worker % a->used];
+    cpu_set_t set;
+    if (0 != server_cpuset_parse(&set, ds->value.ptr)) return -1;
+    if (0 != sched_setaffinity(0, sizeof(set), &set)) {
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "sched_setaffinity() %s", ds->value.ptr);
+        return -1;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) return cpu;
+    }
+    return -1;
+}
+
+__attribute_cold__
+static void server_cpu_affinity_reuseport_bpf (server * const srv) {
+    /* map each CPU to first worker pinned to a CPU set containing the CPU */
+    const array * const a = srv->srvconf.cpu_affinity;
+    const int nworkers = (int)srv->srvconf.max_worker;
+    if (NULL == a || 0 == a->used || nworkers < 2) {
+        log_error(srv->errh, __FILE__, __LINE__,
+          "server.reuseport-bpf requires server.cpu-affinity and "
+          "server.max-worker > 1; ignored");
+        return;
+    }
+    int cpu_worker[CPU_SETSIZE];
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) cpu_worker[cpu] = -1;
+    for (int w = nworkers-1; w >= 0; --w) {
+        cpu_set_t set;
+        const data_string * const ds =
+          (const data_string *)a->data[(uint32_t)w % a->used];
+        if (0 != server_cpuset_parse(&set, ds->value.ptr)) continue;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) cpu_worker[cpu] = w;
+        }
+    }
+    network_reuseport_bpf(srv, cpu_worker, CPU_SETSIZE, nworkers);
+}
+
+#else
+
+__attribute_cold__
+static int server_cpu_affinity_check (server * const srv) {
+    if (srv->srvconf.cpu_affinity && srv->srvconf.cpu_affinity->used)
+        log_error(srv->errh, __FILE__, __LINE__,
+          "server.cpu-affinity not supported on this platform; ignored");
+    return 0;
+}
+
+#define server_cpu_affinity_set(srv, worker) (-1)
+
+#endif /* HAVE_SCHED_SETAFFINITY */
+
 __attribute_cold__
 static int server_main_setup (server * const srv, int argc, char **argv) {
 	int print_config = 0;
@@ -1334,12 +1476,33 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 #endif
 	}
 
+	if (0 != server_cpu_affinity_check(srv)) {
+		return -1;
+	}
+
 	/* we need root-perms for port < 1024 */
 	if (0 != network_init(srv, srv->stdin_fd)) {
 		return -1;
 	}
 	srv->stdin_fd = -1;
 
+	/* server.upgrade-socket: listen for new server (binary) requesting
+	 * listen sockets (after network_init() received any from prev gen) */
+	if (srv->srvconf.upgrade_socket && -1 == upgrade_fd
+	    && !srv->sockets_disabled && !srv->srvconf.preflight_check) {
+		upgrade_fd = network_upgrade_listen(srv);
+		if (-1 == upgrade_fd) return -1;
+	}
+
+	if (srv->srvconf.reuseport_bpf) {
+	  #ifdef HAVE_SCHED_SETAFFINITY
+		server_cpu_affinity_reuseport_bpf(srv);
+	  #else
+		log_error(srv->errh, __FILE__, __LINE__,
+		  "server.reuseport-bpf not supported on this platform; ignored");
+	  #endif
+	}
+
 	if (i_am_root) {
 #ifdef HAVE_PWD_H
 		/* set user and group */
@@ -1465,6 +1628,9 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 	sigaction(SIGHUP,  &act, NULL);
 	sigaction(SIGALRM, &act, NULL);
 	sigaction(SIGUSR1, &act, NULL);
+# ifdef SIGIO
+	sigaction(SIGIO,   &act, NULL);
+# endif
 
 	/* it should be safe to restart syscalls after SIGCHLD */
 	act.sa_flags |= SA_RESTART | SA_NOCLDSTOP;
@@ -1479,6 +1645,9 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 	signal(SIGCHLD,  signal_handler);
 	signal(SIGINT,  signal_handler);
 	signal(SIGUSR1, signal_handler);
+  #ifdef SIGIO
+	signal(SIGIO,   signal_handler);
+  #endif
 #endif
 
 
@@ -1486,6 +1655,20 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 	srv->uid = getuid();
 	srv->pid = getpid();
 
+	/* server.upgrade-socket: SIGIO upon connect() from new server (binary)
+	 * (F_SETOWN after daemonize(); SIGIO to (master) server process) */
+  #if defined(F_SETOWN) && defined(O_ASYNC)
+	if (-1 != upgrade_fd
+	    && (-1 == fcntl(upgrade_fd, F_SETOWN, srv->pid)
+	        || -1 == fcntl(upgrade_fd, F_SETFL,
+	                       fcntl(upgrade_fd, F_GETFL) | O_ASYNC))) {
+		log_perror(srv->errh, __FILE__, __LINE__,
+		  "server.upgrade-socket fcntl()");
+		close(upgrade_fd);
+		upgrade_fd = -1;
+	}
+  #endif
+
 	/* write pid file */
 	if (pid_fd > 2) {
 		buffer * const tb = srv->tmp_buf;
@@ -1551,26 +1734,31 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 		pid_t pid;
 		const int npids = num_childs;
 		int child = 0;
+		int worker = 0;
 		unsigned int timer = 0;
 		for (int n = 0; n < npids; ++n) pids[n] = -1;
-		server_graceful_signal_prev_generation();
+		server_graceful_signal_prev_generation_warmup(srv);
+		if (prev_gen_ts) alarm((timer = srv->srvconf.upgrade_warmup));
 		while (!child && !srv_shutdown && !graceful_shutdown) {
 			if (num_childs > 0) {
+				for (worker = 0; worker < npids; ++worker) {
+					if (-1 == pids[worker]) break;
+				}
 				switch ((pid = fork())) {
 				case -1:
 					return -1;
 				case 0:
 					child = 1;
 					alarm(0);
+					prev_gen_ts = 0;
+					if (-1 != upgrade_fd) {
+						close(upgrade_fd);
+						upgrade_fd = -1;
+					}
 					break;
 				default:
 					num_childs--;
-					for (int n = 0; n < npids; ++n) {
-						if (-1 == pids[n]) {
-							pids[n] = pid;
-							break;
-						}
-					}
+					pids[worker] = pid;
 					break;
 				}
 			} else {
@@ -1616,11 +1804,19 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 								if (pids[n] > 0) kill(pids[n], SIGHUP);
 							}
 						}
+						if (handle_sig_io) {
+							handle_sig_io = 0;
+							network_upgrade_handover(srv, upgrade_fd);
+						}
 						if (handle_sig_alarm) {
 							handle_sig_alarm = 0;
 							timer = 0;
 							plugins_call_handle_trigger(srv);
 							fdevent_restart_logger_pipes(log_epoch_secs);
+							if (prev_gen_ts && prev_gen_ts <= log_epoch_secs) {
+								prev_gen_ts = 0;
+								server_graceful_signal_prev_generation();
+							}
 						}
 						break;
 					default:
@@ -1673,9 +1869,17 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 		fdevent_clr_logger_pipe_pids();
 		srv->pid = getpid();
 		li_rand_reseed();
+
+		/* keep only listen sockets assigned to this worker (server.reuseport)
+		 * after pinning worker to CPU set (server.cpu-affinity) */
+		network_reuseport_worker(srv, worker, npids,
+		                         server_cpu_affinity_set(srv, worker));
 	}
 #endif
 
+	if (0 == srv->srvconf.max_worker)
+		(void)server_cpu_affinity_set(srv, 0);
+
 	srv->max_fds = (int)srv->srvconf.max_fds;
 	srv->ev = fdevent_init(srv->srvconf.event_handler, &srv->max_fds, &srv->cur_fds, srv->errh);
 	if (NULL == srv->ev) {
@@ -1683,6 +1887,28 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 		return -1;
 	}
 
+	if (srv->srvconf.feature_flags
+	    && config_plugin_value_tobool(
+	          array_get_element_klen(srv->srvconf.feature_flags,
+	            CONST_STR_LEN("server.edge-triggered")), 0)) {
+		if (fdevent_features(srv->ev) & FDEVENT_ET)
+			srv->srvconf.edge_triggered = 1;
+		else
+			log_error(srv->errh, __FILE__, __LINE__,
+			  "server.edge-triggered ignored; "
+			  "not supported by server.event-handler = \"%s\"",
+			  srv->srvconf.event_handler);
+	}
+
+	if (srv->srvconf.busy_poll
+	    || (srv->srvconf.feature_flags
+	        && config_plugin_value_tobool(
+	             array_get_element_klen(srv->srvconf.feature_flags,
+	               CONST_STR_LEN("server.loop-stats")), 0))) {
+		srv->srvconf.loop_stats = 1;
+		fdevent_track_wake(srv->ev, 1);
+	}
+
 	srv->max_fds_lowat = srv->max_fds * 8 / 10;
 	srv->max_fds_hiwat = srv->max_fds * 9 / 10;
 
@@ -1726,6 +1952,12 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 		return -1;
 	}
 
+	if (0 != aio_prefetch_init(srv)) {
+		log_error(srv->errh, __FILE__, __LINE__,
+		  "aio-prefetch could not be setup, dying.");
+		return -1;
+	}
+
 #ifdef USE_ALARM
 	{
 		/* setup periodic timer (1 second) */
@@ -1769,7 +2001,7 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 	}
 
 	if (0 == srv->srvconf.max_worker)
-		server_graceful_signal_prev_generation();
+		server_graceful_signal_prev_generation_warmup(srv);
 
 	return 1;
 }
@@ -1794,13 +2026,106 @@ static void server_handle_sighup (server * const srv) {
 #endif
 }
 
+/* main loop statistics (server.busy-poll or feature flag server.loop-stats)
+ * log2 histograms (usec) of
+ * - loop-iteration: wake until next wait (dispatching events, running jobs)
+ * - wake-latency: start of wait (incl. busy poll) until woken with events
+ * bucket n counts intervals < 2^n usec (>= 2^(n-1) usec) and the last bucket
+ * counts the remainder */
+#define SERVER_LOOP_HIST_BUCKETS 22
+
+static struct {
+	uint32_t iter[SERVER_LOOP_HIST_BUCKETS];
+	uint32_t wake[SERVER_LOOP_HIST_BUCKETS];
+	uint32_t busy_poll_hits;   /* woken with events while busy polling */
+	uint32_t busy_poll_misses; /* busy poll budget expired; blocking wait */
+	uint64_t iter_ts;          /* start of current iteration */
+} server_loop_stats;
+
+static int server_loop_hist_bucket (uint64_t usec) {
+	int n = 0;
+	while (usec && n < SERVER_LOOP_HIST_BUCKETS-1) { usec >>= 1; ++n; }
+	return n;
+}
+
+__attribute_noinline__
+static int server_loop_poll (server * const srv, const int nowait) {
+	fdevents * const ev = srv->ev;
+	uint64_t ts = fdevent_clock_usec();
+	if (server_loop_stats.iter_ts)
+		++server_loop_stats.iter[
+		    server_loop_hist_bucket(ts - server_loop_stats.iter_ts)];
+
+	if (nowait) { /* jobs pending; do not wait */
+		server_loop_stats.iter_ts = ts;
+		return fdevent_poll(ev, 0);
+	}
+
+	/* server.busy-poll: spin on fdevent_poll() with zero timeout for up to
+	 * busy_poll usec before blocking, trading idle CPU for lower latency */
+	const uint64_t wait_ts = ts;
+	int n = 0;
+	if (srv->srvconf.busy_poll) {
+		const uint64_t spin_ts = ts + srv->srvconf.busy_poll;
+		do {
+			n = fdevent_poll(ev, 0);
+		} while (0 == n && fdevent_clock_usec() < spin_ts);
+		if (n > 0)
+			++server_loop_stats.busy_poll_hits;
+		else
+			++server_loop_stats.busy_poll_misses;
+	}
+	if (0 == n)
+		n = fdevent_poll(ev, 1000);
+
+	if (n > 0) {
+		/*(fdevent_wake_ts() is 0 if not supported by backend (libev))*/
+		ts = fdevent_wake_ts(ev);
+		if (0 == ts) ts = fdevent_clock_usec();
+		++server_loop_stats.wake[server_loop_hist_bucket(ts - wait_ts)];
+	}
+	else
+		ts = fdevent_clock_usec();
+	server_loop_stats.iter_ts = ts;
+	return n;
+}
+
+__attribute_cold__
+static void server_loop_stats_publish (const server * const srv) {
+	char key[64];
+	for (int i = 0; i < SERVER_LOOP_HIST_BUCKETS; ++i) {
+		const char *bucket = (i < SERVER_LOOP_HIST_BUCKETS-1) ? "lt" : "ge";
+		const unsigned int usec = 1u << (i < SERVER_LOOP_HIST_BUCKETS-1 ? i : i-1);
+		int len = snprintf(key, sizeof(key),
+		                   "server.loop-iteration-us.%s-%u", bucket, usec);
+		status_counter_set(key, (size_t)len, (int)server_loop_stats.iter[i]);
+		len = snprintf(key, sizeof(key),
+		               "server.wake-latency-us.%s-%u", bucket, usec);
+		status_counter_set(key, (size_t)len, (int)server_loop_stats.wake[i]);
+	}
+	if (srv->srvconf.busy_poll) {
+		status_counter_set(CONST_STR_LEN("server.busy-poll.hits"),
+		                   (int)server_loop_stats.busy_poll_hits);
+		status_counter_set(CONST_STR_LEN("server.busy-poll.misses"),
+		                   (int)server_loop_stats.busy_poll_misses);
+	}
+}
+
 __attribute_noinline__
 static void server_handle_sigalrm (server * const srv, time_t min_ts, time_t last_active_ts) {
 
+				if (srv->srvconf.loop_stats)
+					server_loop_stats_publish(srv);
+
 				plugins_call_handle_trigger(srv);
 
 				log_epoch_secs = min_ts;
 
+				if (prev_gen_ts && prev_gen_ts <= min_ts) {
+					prev_gen_ts = 0;
+					server_graceful_signal_prev_generation();
+				}
+
 				/* check idle time limit, if enabled */
 				if (idle_limit && idle_limit < min_ts - last_active_ts && !graceful_shutdown) {
 					log_error(srv->errh, __FILE__, __LINE__,
@@ -1826,14 +2151,19 @@ static void server_handle_sigalrm (server * const srv, time_t min_ts, time_t las
 				if (0 == (min_ts & 0x3f)) { /*(once every 64 secs)*/
 					/* free excess chunkqueue buffers every 64 secs */
 					chunkqueue_chunk_pool_clear();
+					/* free idle pooled buffer memory; trim heap */
+					buffer_pool_trim();
 					/* attempt to restart dead piped loggers every 64 secs */
 					if (0 == srv->srvconf.max_worker)
 						fdevent_restart_logger_pipes(min_ts);
 				}
 				/* cleanup stat-cache */
 				stat_cache_trigger_cleanup();
+				/* close sockets once pending MSG_ZEROCOPY sends complete */
+				network_write_zerocopy_maint();
 				/* reset global/aggregate rate limit counters */
 				config_reset_config_bytes_sec(srv->config_data_base);
+				srv->bytes_per_second_cnt[0] = 0;
 				/* if graceful_shutdown, accelerate cleanup of recently completed request/responses */
 				if (graceful_shutdown && !srv_shutdown)
 					server_graceful_shutdown_maint(srv);
@@ -1882,6 +2212,11 @@ static void server_main_loop (server * const srv) {
 			server_handle_sighup(srv);
 		}
 
+		if (handle_sig_io) {
+			handle_sig_io = 0;
+			network_upgrade_handover(srv, upgrade_fd);
+		}
+
 		/*(USE_ALARM not used; fdevent_poll() is effective periodic timer)*/
 	      #ifdef USE_ALARM
 		if (handle_sig_alarm) {
@@ -1920,7 +2255,10 @@ static void server_main_loop (server * const srv) {
 
 		connections * const joblist = connection_joblist;
 
-		if (fdevent_poll(srv->ev, joblist->used ? 0 : 1000) > 0) {
+		++srv->loop_iter; /*(write scheduling; see connection_write_share())*/
+		if (!srv->srvconf.loop_stats
+		    ? fdevent_poll(srv->ev, joblist->used ? 0 : 1000) > 0
+		    : server_loop_poll(srv, joblist->used) > 0) {
 			last_active_ts = log_epoch_secs;
 		}
 
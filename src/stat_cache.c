@@ -5,6 +5,8 @@
 #include "fdevent.h"
 #include "etag.h"
 #include "algo_splaytree.h"
+#include "status_counter.h"
+#include "sys-mmap.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -52,6 +54,10 @@ typedef struct stat_cache {
 	int stat_cache_engine;
 	splay_tree *files; /* nodes of tree are (stat_cache_entry *) */
 	struct stat_cache_fam *scf;
+	size_t mmap_budget;  /* server.mmap-cache-size */
+	size_t mmap_used;
+	stat_cache_entry *mmap_head; /* most recently used */
+	stat_cache_entry *mmap_tail; /* least recently used */
 } stat_cache;
 
 static stat_cache sc;
@@ -795,6 +801,106 @@ static stat_cache_entry * stat_cache_entry_init(void) {
     return sce;
 }
 
+/* shared mmap cache
+ *
+ * Hot static files are mapped once in their entirety and the mapping is
+ * shared by all connections sending the file (network_write mmap backend).
+ * The mapping lives as long as sce->fd, and references to sce held by
+ * FILE_CHUNK (chunk.file.ref) keep the mapping alive while in use.  Mapped
+ * entries are kept on an LRU list; when a new mapping would exceed the
+ * budget, least recently used mappings not in use are unmapped. */
+
+void stat_cache_mmap_budget (size_t bytes) {
+    sc.mmap_budget = bytes;
+}
+
+static void stat_cache_mmap_lru_unlink (stat_cache_entry * const sce) {
+    if (sce->mmap_prev)
+        sce->mmap_prev->mmap_next = sce->mmap_next;
+    else
+        sc.mmap_head = sce->mmap_next;
+    if (sce->mmap_next)
+        sce->mmap_next->mmap_prev = sce->mmap_prev;
+    else
+        sc.mmap_tail = sce->mmap_prev;
+    sce->mmap_prev = sce->mmap_next = NULL;
+}
+
+static void stat_cache_mmap_lru_push (stat_cache_entry * const sce) {
+    sce->mmap_prev = NULL;
+    sce->mmap_next = sc.mmap_head;
+    if (sc.mmap_head)
+        sc.mmap_head->mmap_prev = sce;
+    else
+        sc.mmap_tail = sce;
+    sc.mmap_head = sce;
+}
+
+void stat_cache_entry_munmap (stat_cache_entry * const sce) {
+    if (NULL == sce->mmap_start) return;
+    munmap(sce->mmap_start, sce->mmap_length);
+    stat_cache_mmap_lru_unlink(sce);
+    sc.mmap_used -= sce->mmap_length;
+    sce->mmap_start = NULL;
+    sce->mmap_length = 0;
+    status_counter_set(CONST_STR_LEN("stat-cache.mmap.kbytes"),
+                       (int)(sc.mmap_used >> 10));
+}
+
+const char * stat_cache_entry_mmap (stat_cache_entry * const sce) {
+    if (sce->mmap_start) {
+        if (sc.mmap_head != sce) {
+            stat_cache_mmap_lru_unlink(sce);
+            stat_cache_mmap_lru_push(sce);
+        }
+        status_counter_inc(CONST_STR_LEN("stat-cache.mmap.hits"));
+        return sce->mmap_start;
+    }
+
+    /* (limit single file to fraction of budget to avoid thrashing) */
+    const size_t len = (size_t)sce->st.st_size;
+    if (sce->fd < 0 || 0 == len || len > (sc.mmap_budget >> 2)) return NULL;
+
+    for (stat_cache_entry *e = sc.mmap_tail, *prev;
+         e && sc.mmap_used + len > sc.mmap_budget; e = prev) {
+        prev = e->mmap_prev;
+        if (1 == e->refcnt) { /*(not in use; referenced only by stat_cache)*/
+            stat_cache_entry_munmap(e);
+            status_counter_inc(CONST_STR_LEN("stat-cache.mmap.evictions"));
+        }
+    }
+    if (sc.mmap_used + len > sc.mmap_budget) return NULL;
+
+  #if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+    char * const start = mmap(NULL, len, PROT_READ, MAP_SHARED, sce->fd, 0);
+    if (MAP_FAILED == start) return NULL;
+  #else
+    char * const start = NULL;
+    return NULL;
+  #endif
+  #if defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+    /* (effective for file mappings only if kernel supports THP for
+     *  read-only file mappings; harmless otherwise) */
+    if (len >= 2*1024*1024)
+        (void)madvise(start, len, MADV_HUGEPAGE);
+  #endif
+
+    sce->mmap_start = start;
+    sce->mmap_length = len;
+    stat_cache_mmap_lru_push(sce);
+    sc.mmap_used += len;
+    status_counter_inc(CONST_STR_LEN("stat-cache.mmap.misses"));
+    status_counter_set(CONST_STR_LEN("stat-cache.mmap.kbytes"),
+                       (int)(sc.mmap_used >> 10));
+    return start;
+}
+
+static void stat_cache_entry_close_fd (stat_cache_entry * const sce) {
+    stat_cache_entry_munmap(sce);
+    close(sce->fd);
+    sce->fd = -1;
+}
+
 static void stat_cache_entry_free(void *data) {
     stat_cache_entry *sce = data;
     if (!sce) return;
@@ -810,7 +916,7 @@ static void stat_cache_entry_free(void *data) {
     free(sce->name.ptr);
     free(sce->etag.ptr);
     if (sce->content_type.size) free(sce->content_type.ptr);
-    if (sce->fd >= 0) close(sce->fd);
+    if (sce->fd >= 0) stat_cache_entry_close_fd(sce);
 
     free(sce);
 }
@@ -1098,10 +1204,8 @@ void stat_cache_update_entry(const char *name, uint32_t len,
             buffer_clear(&sce->content_type);
           #endif
             if (sce->fd >= 0) {
-                if (1 == sce->refcnt) {
-                    close(sce->fd);
-                    sce->fd = -1;
-                }
+                if (1 == sce->refcnt)
+                    stat_cache_entry_close_fd(sce);
                 else {
                     --sce->refcnt; /* stat_cache_entry_free(sce); */
                     (*sptree)->data = sce = stat_cache_entry_init();
@@ -1348,10 +1452,8 @@ stat_cache_entry * stat_cache_get_entry(const buffer *name) {
 	if (sce->fd >= 0) {
 		/* close fd if file changed */
 		if (!stat_cache_stat_eq(&sce->st, &st)) {
-			if (1 == sce->refcnt) {
-				close(sce->fd);
-				sce->fd = -1;
-			}
+			if (1 == sce->refcnt)
+				stat_cache_entry_close_fd(sce);
 			else {
 				--sce->refcnt; /* stat_cache_entry_free(sce); */
 				sptree->data = sce = stat_cache_entry_init();
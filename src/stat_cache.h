@@ -20,6 +20,10 @@ typedef struct stat_cache_entry {
   #if defined(HAVE_FAM_H) || defined(HAVE_SYS_INOTIFY_H) || defined(HAVE_SYS_EVENT_H)
     void *fam_dir;
   #endif
+    char *mmap_start;   /* shared mapping of entire file (server.mmap-cache-size) */
+    size_t mmap_length;
+    struct stat_cache_entry *mmap_prev; /* LRU list of mapped entries */
+    struct stat_cache_entry *mmap_next;
     buffer etag;
     buffer content_type;
     struct stat st;
@@ -38,6 +42,13 @@ void stat_cache_free(void);
 
 void stat_cache_entry_refchg(void *data, int mod);
 
+__attribute_cold__
+void stat_cache_mmap_budget(size_t bytes);
+
+const char * stat_cache_entry_mmap(stat_cache_entry *sce);
+
+void stat_cache_entry_munmap(stat_cache_entry *sce);
+
 __attribute_cold__
 void stat_cache_xattrname (const char *name);
 
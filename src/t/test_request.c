@@ -558,6 +558,60 @@ static void test_request_http_request_parse(request_st * const r)
                     "\r\n"));
 }
 
+static uint32_t test_request_header_value_ctl_scalar(const char *v, uint32_t vlen)
+{
+    return http_request_header_value_ctl_scalar(v, vlen, 0);
+}
+
+static void test_request_header_value_ctl(void)
+{
+    /* run each implementation (not only the one selected for this CPU),
+     * with invalid chars at each offset across and between vector widths,
+     * at each alignment, and compare against scalar implementation */
+    uint32_t (*fns[4])(const char *, uint32_t);
+    int nfns = 0;
+    fns[nfns++] = test_request_header_value_ctl_scalar;
+  #ifdef REQUEST_CTL_SSE2
+    fns[nfns++] = http_request_header_value_ctl_sse2;
+   #ifdef REQUEST_CTL_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        fns[nfns++] = http_request_header_value_ctl_avx2;
+   #endif
+  #endif
+
+    static const char valid[] = "\t ~\x80\xff-Az09;=";
+    static const char invalid[] = { 0x00, 0x01, '\n', '\r', 0x1f, 0x7f };
+    char mem[32+100+1];
+    for (uint32_t align = 0; align < 32; align += 3) {
+        char * const buf = mem + align;
+        for (uint32_t len = 0; len <= 100; ++len) {
+            for (uint32_t k = 0; k < len; ++k)
+                buf[k] = valid[k % (sizeof(valid)-1)];
+            buf[len] = '\0'; /*(must not be scanned)*/
+            for (int f = 0; f < nfns; ++f)
+                assert(len == fns[f](buf, len));
+            assert(len == http_request_header_value_ctl(buf, len));
+
+            for (uint32_t i = 0; i < len; ++i) {
+                for (uint32_t c = 0; c < sizeof(invalid); ++c) {
+                    const char save = buf[i];
+                    buf[i] = invalid[c];
+                    if (i + 7 < len) buf[i+7] = 0x00; /*(report first)*/
+                    const uint32_t ref = fns[0](buf, len);
+                    assert(ref == i);
+                    for (int f = 1; f < nfns; ++f)
+                        assert(ref == fns[f](buf, len));
+                    assert(ref == http_request_header_value_ctl(buf, len));
+                    buf[i] = save;
+                    if (i + 7 < len)
+                        buf[i+7] = valid[(i+7) % (sizeof(valid)-1)];
+                }
+            }
+        }
+    }
+}
+
 #include "base.h"
 #include "burl.h"
 #include "log.h"
@@ -575,6 +629,7 @@ int main (void)
                              | HTTP_PARSEOPT_HOST_NORMALIZE;
 
     test_request_http_request_parse(&r);
+    test_request_header_value_ctl();
 
     free(r.target_orig.ptr);
     free(r.target.ptr);